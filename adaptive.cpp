@@ -0,0 +1,145 @@
+#include "adaptive.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace
+{
+// pixels handed to one task of the refinement pass
+constexpr int REFINE_CHUNK = 64;
+
+struct EdgePixel
+{
+    int row, column;
+    // larger values are refined first, object boundaries rank above pure color differences
+    double contrast;
+};
+
+double color_difference(const RGB &a, const RGB &b)
+{
+    return std::max({std::fabs(a.x - b.x), std::fabs(a.y - b.y), std::fabs(a.z - b.z)});
+}
+}
+
+AdaptiveStats rt_adaptive(std::vector<vec3> u, const Scene &scene, const BVH &bvh,
+                          const Camera &cam, Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings,
+                          const AdaptiveSettings &adaptive, int first_row, int row_count)
+{
+    AdaptiveStats stats;
+    int width = cam.image_width;
+    int rows = std::min(first_row + row_count, static_cast<int>(cam.image_height)) - first_row;
+    if (rows <= 0)
+        return stats;
+
+    std::vector<int> hit_ids(static_cast<size_t>(rows) * frame_buffer.get_width());
+    stats.segments = rt_rows(u, scene, bvh, cam, frame_buffer, pool, settings, first_row, rows, hit_ids.data()).segments;
+    stats.primary_rays = static_cast<int64_t>(rows) * width;
+
+    // the rows next to the band are traced too, so edges along the borders of a band are found like inside it.
+    // They belong to the neighbouring bands and are neither refined nor counted here
+    bool has_above = first_row > 0, has_below = first_row + rows < static_cast<int>(cam.image_height);
+    Framebuffer above(width, 1, frame_buffer.get_precision()), below(width, 1, frame_buffer.get_precision());
+    std::vector<int> above_ids(width), below_ids(width);
+    if (has_above)
+        rt_rows(u, scene, bvh, cam, above, pool, settings, first_row - 1, 1, above_ids.data());
+    if (has_below)
+        rt_rows(u, scene, bvh, cam, below, pool, settings, first_row + rows, 1, below_ids.data());
+    // color and hit object of the pixel at band row i, false outside the image
+    auto pixel_at = [&](int i, int j, RGB &color, int &id) {
+        if (j < 0 || j >= width || (i < 0 && !has_above) || (i >= rows && !has_below))
+            return false;
+        if (i < 0)
+        {
+            color = above.get(0, j);
+            id = above_ids[j];
+        }
+        else if (i >= rows)
+        {
+            color = below.get(0, j);
+            id = below_ids[j];
+        }
+        else
+        {
+            color = frame_buffer.get(i, j);
+            id = hit_ids[i * frame_buffer.get_width() + j];
+        }
+        return true;
+    };
+
+    // find the edges, every task scans a band of rows
+    int bands = std::min(rows, pool.size() * 4);
+    std::vector<std::vector<EdgePixel>> band_edges(bands);
+    pool.parallel_for(bands, [&](int band, int) {
+        for (int i = band * rows / bands; i < (band + 1) * rows / bands; i++)
+        {
+            for (int j = 0; j < width; j++)
+            {
+                RGB color = frame_buffer.get(i, j);
+                int id = hit_ids[i * frame_buffer.get_width() + j];
+                double contrast = 0;
+                const int neighbours[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+                for (auto &offset : neighbours)
+                {
+                    RGB neighbour_color;
+                    int neighbour_id;
+                    if (!pixel_at(i + offset[0], j + offset[1], neighbour_color, neighbour_id))
+                        continue;
+                    double difference = color_difference(color, neighbour_color);
+                    if (neighbour_id != id)
+                        difference += 2;
+                    contrast = std::max(contrast, difference);
+                }
+                if (contrast > adaptive.threshold)
+                    band_edges[band].push_back({i, j, contrast});
+            }
+        }
+    });
+    std::vector<EdgePixel> edges;
+    for (auto &band : band_edges)
+    {
+        edges.insert(edges.end(), band.begin(), band.end());
+    }
+    stats.edge_pixels = edges.size();
+
+    // refined pixels are replaced by the mean of a grid x grid sub-pixel pattern
+    int grid = std::max(1, static_cast<int>(std::lround(std::sqrt(static_cast<double>(adaptive.max_samples)))));
+    int samples = grid * grid;
+    if (samples <= 1 || edges.empty())
+        return stats;
+
+    size_t refined = edges.size();
+    if (adaptive.budget > 0)
+    {
+        stats.budget_rays = static_cast<int64_t>(adaptive.budget * stats.primary_rays);
+        refined = std::min(refined, static_cast<size_t>(stats.budget_rays / samples));
+        std::nth_element(edges.begin(), edges.begin() + refined, edges.end(),
+                         [](const EdgePixel &a, const EdgePixel &b) { return a.contrast > b.contrast; });
+    }
+    stats.refined_pixels = refined;
+    stats.extra_rays = static_cast<int64_t>(refined) * samples;
+
+    int chunks = (refined + REFINE_CHUNK - 1) / REFINE_CHUNK;
+    std::atomic<int64_t> extra_segments{0};
+    pool.parallel_for(chunks, [&](int chunk, int) {
+        int segments = 0;
+        size_t end = std::min(refined, static_cast<size_t>(chunk + 1) * REFINE_CHUNK);
+        for (size_t k = static_cast<size_t>(chunk) * REFINE_CHUNK; k < end; k++)
+        {
+            const EdgePixel &pixel = edges[k];
+            RGB sum(0, 0, 0);
+            for (int sy = 0; sy < grid; sy++)
+            {
+                for (int sx = 0; sx < grid; sx++)
+                {
+                    double x = pixel.column + (sx + 0.5) / grid - 0.5;
+                    double y = first_row + pixel.row + (sy + 0.5) / grid - 0.5;
+                    sum = sum + trace_ray(scene, bvh, primary_ray(u, cam, x, y), settings, segments);
+                }
+            }
+            frame_buffer.set(pixel.row, pixel.column, sum / samples);
+        }
+        extra_segments += segments;
+    });
+    stats.segments += extra_segments;
+    return stats;
+}
@@ -0,0 +1,45 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+#include <memory>
+#include <vector>
+
+#include "renderer.h"
+#include "framebuffer.h"
+
+/*
+* settings of the adaptive anti-aliasing
+*/
+struct AdaptiveSettings
+{
+    // rays traced for a refined pixel, rounded to a square grid. 16 matches 4x4 supersampling on the edges
+    int max_samples = 16;
+    // largest color channel difference to a neighbour that still counts as smooth
+    double threshold = 0.05;
+    // extra rays per frame as a multiple of the pixel count, 0 removes the limit
+    double budget = 1.0;
+};
+
+struct AdaptiveStats
+{
+    int64_t primary_rays = 0;
+    int64_t extra_rays = 0;
+    // extra rays the budget allowed in this frame
+    int64_t budget_rays = 0;
+    // pixels on an edge and pixels that were actually refined within the budget
+    int edge_pixels = 0;
+    int refined_pixels = 0;
+    // ray segments of all primary and extra rays including their reflections
+    int64_t segments = 0;
+};
+
+/*
+* Render the rows [first_row, first_row + row_count) like rt_rows with one ray per pixel, then supersample
+* only the pixels whose color differs from a neighbour by more than the threshold or which see a different
+* object than a neighbour. If the edges need more rays than the budget allows, the pixels with the highest
+* contrast are refined first. Refined pixels are overwritten, so this is not meant for accumulating samples.
+*/
+AdaptiveStats rt_adaptive(std::vector<vec3> u, const Scene &scene, const BVH &bvh,
+                          const Camera &cam, Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings,
+                          const AdaptiveSettings &adaptive, int first_row, int row_count);
+
+#endif
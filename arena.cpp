@@ -0,0 +1,89 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+
+Arena::~Arena()
+{
+    release();
+}
+
+Arena::Arena(Arena &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+Arena &Arena::operator=(Arena &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        chunks.swap(other.chunks);
+        std::swap(cursor, other.cursor);
+        std::swap(end, other.end);
+        std::swap(used, other.used);
+    }
+    return *this;
+}
+
+void Arena::release()
+{
+    for (Chunk &chunk : chunks)
+        ::operator delete(chunk.data, std::align_val_t(CACHE_LINE_SIZE));
+    chunks.clear();
+    cursor = end = nullptr;
+    used = 0;
+}
+
+void Arena::add_chunk(size_t min_size)
+{
+    size_t size = std::max(CHUNK_SIZE, (min_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE);
+    char *data = static_cast<char *>(::operator new(size, std::align_val_t(CACHE_LINE_SIZE)));
+    chunks.push_back({data, size});
+    cursor = data;
+    end = data + size;
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+    // chunks are cache line aligned, larger alignments may need up to alignment - 1 bytes of padding
+    size_t padding = cursor ? (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment : 0;
+    if (!cursor || padding + size > static_cast<size_t>(end - cursor))
+    {
+        add_chunk(size + (alignment > CACHE_LINE_SIZE ? alignment : 0));
+        padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+    }
+    void *memory = cursor + padding;
+    cursor += padding + size;
+    used += size;
+    return memory;
+}
+
+void Arena::append(Arena &&other)
+{
+    if (other.chunks.empty())
+        return;
+    // keep allocating from the current chunk, the appended ones are full enough
+    Chunk current = chunks.empty() ? Chunk{nullptr, 0} : chunks.back();
+    if (!chunks.empty())
+        chunks.pop_back();
+    chunks.insert(chunks.end(), other.chunks.begin(), other.chunks.end());
+    if (current.data)
+        chunks.push_back(current);
+    else
+    {
+        cursor = other.cursor;
+        end = other.end;
+    }
+    used += other.used;
+    other.chunks.clear();
+    other.cursor = other.end = nullptr;
+    other.used = 0;
+}
+
+size_t Arena::reserved_bytes() const
+{
+    size_t reserved = 0;
+    for (const Chunk &chunk : chunks)
+        reserved += chunk.size;
+    return reserved;
+}
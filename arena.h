@@ -0,0 +1,66 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// size of a cache line on the supported CPUs
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/*
+* Bump allocator for objects that live as long as their owner. Memory comes in cache line aligned chunks and
+* is only given back all at once when the arena is destroyed. The arena does not run destructors, the owner
+* of the objects does that before the arena goes away.
+*/
+class Arena
+{
+    struct Chunk
+    {
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    char *cursor = nullptr;
+    char *end = nullptr;
+    size_t used = 0;
+
+    void add_chunk(size_t min_size);
+    // free all chunks
+    void release();
+
+public:
+    // size of a regular chunk, larger allocations get a chunk of their own
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    Arena() {}
+    ~Arena();
+    Arena(Arena &&other) noexcept;
+    Arena &operator=(Arena &&other) noexcept;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t alignment);
+
+    /*
+    * Construct an object in the arena. Objects start on a cache line and sizes are rounded up to whole lines,
+    * so no object shares a line with its neighbour or straddles two lines when it fits into one.
+    */
+    template <class T, class... Args>
+    T *create(Args &&...args)
+    {
+        size_t size = (sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+        void *memory = allocate(size, alignof(T) > CACHE_LINE_SIZE ? alignof(T) : CACHE_LINE_SIZE);
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    // take over the chunks of other, which is left empty. Objects in them keep their addresses
+    void append(Arena &&other);
+
+    size_t used_bytes() const { return used; }
+    size_t reserved_bytes() const;
+    size_t chunk_count() const { return chunks.size(); }
+};
+
+#endif
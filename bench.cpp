@@ -0,0 +1,809 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "scene.h"
+#include "bvh.h"
+#include "renderer.h"
+#include "thread_pool.h"
+#include "progressive.h"
+#include "gbuffer.h"
+#include "temporal.h"
+#include "resolution.h"
+#include "wavefront.h"
+#include "adaptive.h"
+#include "mesh_io.h"
+#include "scene_file.h"
+#include "instance.h"
+
+/*
+* Benchmarks for the hit queries. Run with the number of scene objects as argument, i.e.
+* ./RaytracerBench --benchmark_filter=ClosestHit
+*/
+
+namespace
+{
+// random spheres scattered in a cube in front of the camera
+Scene random_spheres(int count)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> position(-10, 10);
+    std::uniform_real_distribution<double> radius(.05, .3);
+    Scene scene;
+    for (int i = 0; i < count; i++)
+    {
+        scene.add<Sphere>(DEFAULT_MATERIAL, point3(position(rng), position(rng), position(rng)), radius(rng));
+    }
+    return scene;
+}
+
+// sphere that hides its type from the BVH, so it is tested through the virtual slow path
+class CustomSphere : public SceneGeometry
+{
+    Sphere sphere;
+
+public:
+    CustomSphere(const Sphere &sphere) : SceneGeometry{sphere.material_index()}, sphere{sphere} {}
+    Collision intersect(const ray &r) const override { return sphere.intersect(r); }
+    AABB bounds() const override { return sphere.bounds(); }
+};
+
+Scene random_custom_spheres(int count)
+{
+    auto spheres = random_spheres(count);
+    Scene scene;
+    for (auto &sphere : spheres)
+    {
+        scene.add<CustomSphere>(static_cast<const Sphere &>(*sphere));
+    }
+    return scene;
+}
+
+// the interactive scene with a few reflective spheres added in front of the walls
+Scene reflective_scene()
+{
+    Scene scene;
+    scene.add<Sphere>(scene.add_material(Material(RGB(0, 1, 0),0.5)), point3( 1.5, 0, 0), .5);
+    scene.add<Wall>(scene.add_material(Material(RGB(0, 0, 1))), point3(3.0, 2, 0) , vec3(0,-1,0), 1, 1);
+    scene.add<Wall>(scene.add_material(Material(RGB(0, 1, 0))), point3(3.0, -3, 0), vec3(0,1,0), 2,  2);
+    uint32_t white = scene.add_material(Material(RGB(1, 1, 1), 0.9));
+    for (int i = 0; i < 8; i++)
+    {
+        scene.add<Sphere>(white, point3(2.5, -1.75 + i * .5, .5 * (i % 2)), .2);
+    }
+    return scene;
+}
+
+/*
+* two parallel mirrors in front of the camera with a sphere between them, so most rays bounce many times
+*/
+Scene mirror_scene()
+{
+    Scene scene;
+    uint32_t mirror = scene.add_material(Material(RGB(1, 1, 1), 0.9));
+    scene.add<Wall>(mirror, point3(9, 1, -4), vec3(0, -1, 0), 8, 8);
+    scene.add<Wall>(mirror, point3(1, -1, -4), vec3(0, 1, 0), 8, 8);
+    scene.add<Sphere>(scene.add_material(Material(RGB(1, 0, 0), 0.5)), point3(3, 0, 0), .5);
+    return scene;
+}
+
+Camera benchmark_camera(int width)
+{
+    Camera cam;
+    cam.aspect_ratio = 4. / 3.;
+    cam.image_width = width;
+    cam.vfov = 90;
+    cam.position = point3(0,0,0);
+    cam.lookat   = point3(-1,0,0);
+    cam.vup      = vec3(0,0,-1);
+    return cam;
+}
+
+std::vector<ray> random_rays(int count)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> direction(-1, 1);
+    std::vector<ray> rays;
+    for (int i = 0; i < count; i++)
+    {
+        rays.push_back(ray(vec3(direction(rng), direction(rng), direction(rng)), point3(0, 0, 0)));
+    }
+    return rays;
+}
+}
+
+static void BM_ClosestHitLinear(benchmark::State &state)
+{
+    auto scene = random_spheres(state.range(0));
+    auto rays = random_rays(1024);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(linear_closest_hit(scene, rays[i++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClosestHitLinear)->RangeMultiplier(4)->Range(16, 16384);
+
+static void BM_ClosestHitBVH(benchmark::State &state)
+{
+    auto scene = random_spheres(state.range(0));
+    auto rays = random_rays(1024);
+    BVH bvh(scene);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bvh.closest_hit(scene, rays[i++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClosestHitBVH)->RangeMultiplier(4)->Range(16, 16384);
+
+/*
+* Same query as BM_ClosestHitBVH, but every sphere goes through the virtual intersect instead of the packed kernel
+*/
+static void BM_ClosestHitBVHVirtual(benchmark::State &state)
+{
+    auto scene = random_custom_spheres(state.range(0));
+    auto rays = random_rays(1024);
+    BVH bvh(scene);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bvh.closest_hit(scene, rays[i++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClosestHitBVHVirtual)->RangeMultiplier(4)->Range(16, 16384);
+
+/*
+* Primary visibility only: the first hit of every pixel of a frame, traced one ray at a time or as packets.
+* Arguments are the image width and whether packets are used.
+*/
+static void BM_PrimaryVisibility(benchmark::State &state)
+{
+    auto scene = random_spheres(4096);
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(state.range(0));
+    cam.aspect_ratio = state.range(0) > 640 ? 16. / 9. : 4. / 3.;
+    cam.position = point3(0, 0, 12);
+    // camera rays point away from lookat, see Camera::init
+    cam.lookat = point3(0, 0, 24);
+    cam.vup = vec3(0, 1, 0);
+    auto u = cam.init();
+    int width = cam.image_width, height = cam.image_height;
+    bool packets = state.range(1);
+
+    for (auto _ : state)
+    {
+        for (int i = 0; i < height; i += PACKET_WIDTH)
+        {
+            for (int j = 0; j < width; j += PACKET_WIDTH)
+            {
+                if (packets)
+                {
+                    RayPacket packet;
+                    packet.origin = cam.position;
+                    for (int lane = 0; lane < PACKET_SIZE; lane++)
+                    {
+                        packet.set_direction(lane, cam.position - (cam.image_top_left + u[0] * (j + lane % PACKET_WIDTH) + u[1] * (i + lane / PACKET_WIDTH)));
+                    }
+                    packet.active = (1u << PACKET_SIZE) - 1;
+                    packet.finalize();
+                    Collision collisions[PACKET_SIZE];
+                    bvh.closest_hit(scene, packet, collisions);
+                    benchmark::DoNotOptimize(collisions);
+                }
+                else
+                {
+                    for (int lane = 0; lane < PACKET_SIZE; lane++)
+                    {
+                        vec3 direction = cam.position - (cam.image_top_left + u[0] * (j + lane % PACKET_WIDTH) + u[1] * (i + lane / PACKET_WIDTH));
+                        benchmark::DoNotOptimize(bvh.closest_hit(scene, ray(direction, cam.position)));
+                    }
+                }
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(width * height));
+}
+BENCHMARK(BM_PrimaryVisibility)->ArgsProduct({{640, 3840}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+static void BM_BVHBuild(benchmark::State &state)
+{
+    auto scene = random_spheres(state.range(0));
+    BVH bvh;
+    for (auto _ : state)
+    {
+        bvh.build(scene);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BVHBuild)->RangeMultiplier(4)->Range(16, 16384);
+
+static void BM_BVHRefit(benchmark::State &state)
+{
+    auto scene = random_spheres(state.range(0));
+    BVH bvh(scene);
+    for (auto _ : state)
+    {
+        bvh.refit(scene);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BVHRefit)->RangeMultiplier(4)->Range(16, 16384);
+
+/*
+* Moving range(0) of 16384 random spheres by a small step per iteration and bringing the hierarchy up to date.
+* range(1) selects a full rebuild (0), a refit of the whole tree (1) or BVH::update with the moving spheres
+* marked dynamic and dirty (2), which only touches the small tree of the moving spheres.
+*/
+static void BM_DynamicUpdate(benchmark::State &state)
+{
+    auto scene = random_spheres(16384);
+    int moving = state.range(0);
+    int mode = state.range(1);
+    for (int i = 0; i < moving; i++)
+        scene.set_dynamic(i, mode == 2);
+    BVH bvh(scene);
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<double> step(-.05, .05);
+    for (auto _ : state)
+    {
+        for (int i = 0; i < moving; i++)
+        {
+            auto sphere = static_cast<Sphere *>(scene[i]);
+            sphere->set_center(sphere->get_center() + vec3(step(rng), step(rng), step(rng)));
+            scene.mark_dirty(i);
+        }
+        if (mode == 0)
+            bvh.build(scene);
+        else if (mode == 1)
+            bvh.refit(scene);
+        else
+            bvh.update(scene);
+        scene.clear_dirty();
+    }
+    state.SetItemsProcessed(state.iterations() * moving);
+}
+BENCHMARK(BM_DynamicUpdate)->ArgsProduct({{16, 256}, {0, 1, 2}})->Unit(benchmark::kMicrosecond);
+
+/*
+* Frame time against the number of render threads, the argument is the thread count
+*/
+static void BM_RenderFrame(benchmark::State &state)
+{
+    auto scene = reflective_scene();
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(state.range(0));
+    for (auto _ : state)
+    {
+        rt_scene(u, scene, bvh, cam, frame_buffer, pool);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cam.image_width * cam.image_height));
+}
+BENCHMARK(BM_RenderFrame)->DenseRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/*
+* A frame of the reflective scene at 640x480 after a material change. range(0) = 0 traces it with rt_scene,
+* 1 reshades it from the G-buffer of the render cache, 2 is a frame where nothing changed and the cache copies
+* the previous colors.
+*/
+static void BM_RenderCache(benchmark::State &state)
+{
+    auto scene = reflective_scene();
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(1);
+    RenderCache cache(cam.image_width, cam.image_height);
+    cache.render(u, scene, bvh, cam, pool, RenderSettings(), frame_buffer);
+    Material material = scene.material(1);
+    int frame = 0;
+    for (auto _ : state)
+    {
+        if (state.range(0) < 2)
+        {
+            material.color = RGB(frame % 2, 1, 0);
+            scene.set_material(1, material);
+            frame++;
+        }
+        if (state.range(0) == 0)
+            rt_scene(u, scene, bvh, cam, frame_buffer, pool);
+        else
+            cache.render(u, scene, bvh, cam, pool, RenderSettings(), frame_buffer);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cam.image_width * cam.image_height));
+}
+BENCHMARK(BM_RenderCache)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+
+/*
+* Frames of a camera walking through the reflective scene, one thread. Argument 0 traces every frame with
+* rt_scene, otherwise the previous frame is reprojected with range(0) as the refresh interval
+*/
+static void BM_Temporal(benchmark::State &state)
+{
+    auto scene = reflective_scene();
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    cam.movement_speed = .01;
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(1);
+    TemporalRenderer temporal(cam.image_width, cam.image_height);
+    temporal.settings.refresh_interval = std::max<int64_t>(state.range(0), 1);
+    int frame = 0;
+    for (auto _ : state)
+    {
+        // walk forward and back so the view stays in the scene
+        if (frame++ % 64 < 32)
+            cam.forward();
+        else
+            cam.backward();
+        if (state.range(0) == 0)
+            rt_scene(u, scene, bvh, cam, frame_buffer, pool);
+        else
+            temporal.render(u, scene, bvh, cam, pool, RenderSettings(), frame_buffer);
+    }
+    state.counters["reused_percent"] = temporal.stats().reused_fraction() * 100;
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cam.image_width * cam.image_height));
+}
+BENCHMARK(BM_Temporal)->Arg(0)->Arg(4)->Arg(16)->Unit(benchmark::kMillisecond);
+
+/*
+* Frames of the reflective scene with a render time budget of range(0) ms, one thread. The controller settles
+* within the first frames, 0 renders every frame at full resolution
+*/
+static void BM_DynamicResolution(benchmark::State &state)
+{
+    auto scene = reflective_scene();
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(1);
+    ResolutionSettings settings;
+    settings.target_ms = state.range(0);
+    DynamicResolution dynamic_resolution(settings);
+    for (auto _ : state)
+    {
+        if (state.range(0) == 0)
+            rt_scene(u, scene, bvh, cam, frame_buffer, pool);
+        else
+            dynamic_resolution.render(u, scene, bvh, cam, pool, RenderSettings(), frame_buffer);
+    }
+    state.counters["scale"] = state.range(0) == 0 ? 1 : dynamic_resolution.stats().scale;
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cam.image_width * cam.image_height));
+}
+BENCHMARK(BM_DynamicResolution)->Arg(0)->Arg(16)->Arg(8)->Unit(benchmark::kMillisecond);
+
+/*
+* Shading with range(0) point lights scattered among 1024 spheres, one thread. The light ranges shrink with the
+* light count so every point is reached by a similar number of lights. range(1) = 1 culls the lights with the
+* light grid, 0 visits every light at every hit. range(2) = 1 traces shadow rays.
+*/
+static void BM_Lights(benchmark::State &state)
+{
+    auto scene = random_spheres(1024);
+    BVH bvh(scene);
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> position(-10, 10);
+    int light_count = state.range(0);
+    std::vector<Light> lights;
+    for (int i = 0; i < light_count; i++)
+        lights.push_back(Light::point(point3(position(rng), position(rng), position(rng)), RGB(1, 1, 1), 30 / std::cbrt(light_count)));
+    LightSet light_set(lights, state.range(1) == 1);
+    RenderSettings settings;
+    settings.lights = &light_set;
+    settings.shadows = state.range(2) == 1;
+
+    Camera cam = benchmark_camera(320);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(1);
+    for (auto _ : state)
+    {
+        rt_scene(u, scene, bvh, cam, frame_buffer, pool, settings);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(cam.image_width * cam.image_height));
+}
+BENCHMARK(BM_Lights)->ArgsProduct({{1, 16, 256}, {0, 1}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+/*
+* Path termination in a scene of facing mirrors. Argument 0 follows every path to the maximum depth like the
+* former recursive tracer, 1 ends paths below the throughput threshold and 2 uses russian roulette instead
+*/
+static void BM_PathTermination(benchmark::State &state)
+{
+    auto scene = mirror_scene();
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(1);
+    RenderSettings settings;
+    if (state.range(0) == 0)
+        settings.min_throughput = 0;
+    settings.russian_roulette = state.range(0) == 2;
+    RenderStats stats;
+    for (auto _ : state)
+    {
+        stats = rt_scene(u, scene, bvh, cam, frame_buffer, pool, settings);
+    }
+    state.counters["segments_per_path"] = stats.average_bounces();
+}
+BENCHMARK(BM_PathTermination)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+
+/*
+* Reflection rays per second in the mirror scene with range(0) bounces, traced depth first per tile
+* (range(1) = 0) or as sorted wavefronts (range(1) = 1) on all hardware threads. range(2) small spheres are
+* scattered between the mirrors, so the reflections of a larger scene no longer stay in cache
+*/
+static void BM_Wavefront(benchmark::State &state)
+{
+    auto scene = mirror_scene();
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> x(2, 8), y(-.9, .9), z(-3, 3), radius(.02, .08);
+    for (int i = 0; i < state.range(2); i++)
+        scene.add<Sphere>(DEFAULT_MATERIAL, point3(x(rng), y(rng), z(rng)), radius(rng));
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    RenderSettings settings;
+    settings.max_bounces = state.range(0);
+    settings.wavefront = state.range(1) == 1;
+    int64_t segments = 0;
+    for (auto _ : state)
+    {
+        segments += rt_scene(u, scene, bvh, cam, frame_buffer, pool, settings).segments;
+    }
+    state.SetItemsProcessed(segments);
+}
+BENCHMARK(BM_Wavefront)->ArgsProduct({{2, 4, 6, 8, 10}, {0, 1}, {0, 16384}})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/*
+* Anti-aliasing cost, argument 0 is 16x supersampling of every pixel and 1 adaptive sampling with up to
+* 16 rays on the edges. rays_per_pixel counts the primary and supersampling rays.
+*/
+static void BM_AntiAliasing(benchmark::State &state)
+{
+    auto scene = reflective_scene();
+    BVH bvh(scene);
+    Camera cam = benchmark_camera(640);
+    auto u = cam.init();
+    Framebuffer frame_buffer(cam.image_width, cam.image_height);
+    ThreadPool pool(1);
+    AdaptiveSettings adaptive;
+    adaptive.budget = 0;
+    int64_t rays = 0;
+    for (auto _ : state)
+    {
+        if (state.range(0) == 0)
+        {
+            for (int sample = 0; sample < 16; sample++)
+            {
+                rt_scene(u, scene, bvh, cam, frame_buffer, pool, sample_settings(RenderSettings(), sample));
+            }
+            rays += 16 * static_cast<int64_t>(cam.image_width * cam.image_height);
+        }
+        else
+        {
+            AdaptiveStats stats = rt_adaptive(u, scene, bvh, cam, frame_buffer, pool, RenderSettings(), adaptive, 0, cam.image_height);
+            rays += stats.primary_rays + stats.extra_rays;
+        }
+    }
+    state.counters["rays_per_pixel"] = static_cast<double>(rays) / state.iterations() / (cam.image_width * cam.image_height);
+}
+BENCHMARK(BM_AntiAliasing)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+/*
+* The former double vector with its operators compiled out of line, kept to compare against the inlined templates
+*/
+struct legacy_vec3
+{
+    using scalar = double;
+    double x, y, z;
+    legacy_vec3() : x{0}, y{0}, z{0} {}
+    legacy_vec3(double x, double y, double z) : x{x}, y{y}, z{z} {}
+    legacy_vec3 operator-(const legacy_vec3 other) const;
+    legacy_vec3 operator*(const double d) const;
+    legacy_vec3 operator/(const double t) const;
+    double length_squared() const;
+    legacy_vec3 normalize() const;
+    static double dot(const legacy_vec3 v1, const legacy_vec3 v2);
+    static legacy_vec3 cross(const legacy_vec3 &u, const legacy_vec3 &v);
+    static legacy_vec3 reflect(const legacy_vec3 v, const legacy_vec3 normal);
+};
+
+__attribute__((noinline)) legacy_vec3 legacy_vec3::operator-(const legacy_vec3 other) const { return legacy_vec3(x - other.x, y - other.y, z - other.z); }
+__attribute__((noinline)) legacy_vec3 legacy_vec3::operator*(const double d) const { return legacy_vec3(x * d, y * d, z * d); }
+__attribute__((noinline)) legacy_vec3 legacy_vec3::operator/(const double t) const { return legacy_vec3(x / t, y / t, z / t); }
+__attribute__((noinline)) double legacy_vec3::length_squared() const { return x * x + y * y + z * z; }
+__attribute__((noinline)) legacy_vec3 legacy_vec3::normalize() const { return *this / std::sqrt(length_squared()); }
+__attribute__((noinline)) double legacy_vec3::dot(const legacy_vec3 v1, const legacy_vec3 v2) { return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z; }
+__attribute__((noinline)) legacy_vec3 legacy_vec3::cross(const legacy_vec3 &u, const legacy_vec3 &v)
+{
+    return legacy_vec3(u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x);
+}
+__attribute__((noinline)) legacy_vec3 legacy_vec3::reflect(const legacy_vec3 v, const legacy_vec3 normal)
+{
+    legacy_vec3 normalized_normal = normal.normalize();
+    legacy_vec3 normalized_vec = v.normalize();
+    return normalized_vec - normalized_normal * (2 * dot(normalized_vec, normalized_normal));
+}
+
+/*
+* Shading style vector math (normalize, reflect, dot, cross) over arrays of points and directions, one benchmark
+* per vector type
+*/
+template <typename V>
+static void BM_VectorMath(benchmark::State &state)
+{
+    using T = typename V::scalar;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> coordinate(-10, 10);
+    std::vector<V> points, directions;
+    for (int i = 0; i < 4096; i++)
+    {
+        points.push_back(V(coordinate(rng), coordinate(rng), coordinate(rng)));
+        directions.push_back(V(coordinate(rng), coordinate(rng), coordinate(rng)).normalize());
+    }
+    V center(1, 2, 3), light(0.2, 0.9, 0.4);
+    for (auto _ : state)
+    {
+        T sum = 0;
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            V normal = (points[i] - center).normalize();
+            V reflected = V::reflect(directions[i], normal);
+            sum += V::dot(reflected, light) + V::cross(reflected, normal).length_squared();
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK_TEMPLATE(BM_VectorMath, legacy_vec3);
+BENCHMARK_TEMPLATE(BM_VectorMath, vec3);
+BENCHMARK_TEMPLATE(BM_VectorMath, vec3f);
+BENCHMARK_TEMPLATE(BM_VectorMath, vec3_simd);
+
+/*
+* Conversion of a 1920x1080 frame to 32 bit pixels on one thread. Argument 0 is the float buffer,
+* 1 the half buffer and 2 the previous per-pixel loop over nested vectors for comparison
+*/
+static void BM_ConvertRGBA8(benchmark::State &state)
+{
+    const int width = 1920, height = 1080;
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> value(0, 1.2);
+    std::vector<uint32_t> pixels(width * height);
+    if (state.range(0) == 2)
+    {
+        std::vector<std::vector<RGB>> frame_buffer(height, std::vector<RGB>(width));
+        for (auto &row : frame_buffer)
+            for (auto &pixel : row)
+                pixel = RGB(value(rng), value(rng), value(rng));
+        for (auto _ : state)
+        {
+            for (int i = 0; i < height; i++)
+            {
+                for (int j = 0; j < width; j++)
+                {
+                    RGB val = frame_buffer.at(i).at(j);
+                    uint32_t r = static_cast<uint8_t>(std::min(val.x, 1.0) * 255);
+                    uint32_t g = static_cast<uint8_t>(std::min(val.y, 1.0) * 255);
+                    uint32_t b = static_cast<uint8_t>(std::min(val.z, 1.0) * 255);
+                    pixels[i * width + j] = r << 24 | g << 16 | b << 8 | 255;
+                }
+            }
+            benchmark::DoNotOptimize(pixels.data());
+        }
+    }
+    else
+    {
+        Framebuffer frame_buffer(width, height, state.range(0) == 1 ? PixelPrecision::Half : PixelPrecision::Float);
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++)
+                frame_buffer.set(i, j, RGB(value(rng), value(rng), value(rng)));
+        for (auto _ : state)
+        {
+            frame_buffer.convert_rgba8(pixels.data(), width * 4, PixelLayout(), DisplaySettings(), 0, height);
+            benchmark::DoNotOptimize(pixels.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(width * height));
+}
+BENCHMARK(BM_ConvertRGBA8)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+
+namespace
+{
+/*
+* write a unit sphere at the origin as latitude/longitude quads with vertex normals,
+* 2 * rings * segments triangles
+*/
+std::string write_sphere_obj(int rings, int segments)
+{
+    std::string path = (std::filesystem::temp_directory_path() / ("raytracer_sphere_" + std::to_string(rings) + ".obj")).string();
+    std::ofstream file(path);
+    for (int i = 0; i <= rings; i++)
+    {
+        double theta = M_PI * i / rings;
+        for (int j = 0; j < segments; j++)
+        {
+            double phi = 2 * M_PI * j / segments;
+            double x = std::sin(theta) * std::cos(phi), y = std::sin(theta) * std::sin(phi), z = std::cos(theta);
+            file << "v " << x << " " << y << " " << z << "\nvn " << x << " " << y << " " << z << "\n";
+        }
+    }
+    for (int i = 0; i < rings; i++)
+    {
+        for (int j = 0; j < segments; j++)
+        {
+            int a = i * segments + j + 1, b = i * segments + (j + 1) % segments + 1;
+            int c = a + segments, d = b + segments;
+            file << "f " << a << "//" << a << " " << c << "//" << c << " " << d << "//" << d << " " << b << "//" << b << "\n";
+        }
+    }
+    return path;
+}
+}
+
+/*
+* Loading a tessellated sphere of about 2 * range(0)^2 triangles. Argument 1 selects parsing the OBJ and building
+* the hierarchy (0) or mapping the binary cache (1).
+*/
+static void BM_MeshLoad(benchmark::State &state)
+{
+    std::string path = write_sphere_obj(state.range(0), state.range(0));
+    std::string cache_path = path + ".rtmesh";
+    std::remove(cache_path.c_str());
+    MeshLoadStats stats;
+    if (state.range(1) == 1)
+        load_mesh(path, DEFAULT_MATERIAL);
+    for (auto _ : state)
+    {
+        if (state.range(1) == 0)
+            std::remove(cache_path.c_str());
+        benchmark::DoNotOptimize(load_mesh(path, DEFAULT_MATERIAL, &stats));
+    }
+    state.counters["triangles"] = stats.triangles;
+    state.counters["heap_MB"] = stats.heap_bytes / 1048576.0;
+    state.counters["mapped_MB"] = stats.mapped_bytes / 1048576.0;
+    std::remove(cache_path.c_str());
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_MeshLoad)->ArgsProduct({{64, 512}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+/*
+* Closest hit of random rays against one sphere as a mesh of about 2 * range(0)^2 triangles
+*/
+static void BM_MeshClosestHit(benchmark::State &state)
+{
+    std::string path = write_sphere_obj(state.range(0), state.range(0));
+    auto mesh = load_obj(path, DEFAULT_MATERIAL);
+    std::remove(path.c_str());
+    // rays from outside aimed at points around the sphere, so most of them hit
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> target(-1.2, 1.2);
+    std::vector<ray> rays;
+    for (int k = 0; k < 1024; k++)
+        rays.push_back(ray(point3(target(rng), target(rng), target(rng)) - point3(3, 0, 0), point3(3, 0, 0)));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(mesh->intersect(rays[i++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MeshClosestHit)->RangeMultiplier(8)->Range(8, 512);
+
+/*
+* Parsing a scene description of range(0) random spheres, the hierarchy build is measured by BM_BVHBuild
+*/
+static void BM_SceneParse(benchmark::State &state)
+{
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> position(-10, 10);
+    std::uniform_real_distribution<double> radius(.05, .3);
+    std::ostringstream text;
+    text << "camera position 0 0 0 lookat -1 0 0 up 0 0 -1 fov 90\nmaterial red 1 0 0 metallic 0.5\n";
+    for (int i = 0; i < state.range(0); i++)
+        text << "sphere red " << position(rng) << " " << position(rng) << " " << position(rng) << " " << radius(rng) << "\n";
+    std::string scene_text = text.str();
+    for (auto _ : state)
+    {
+        std::istringstream input(scene_text);
+        Scene scene;
+        Camera cam;
+        std::vector<Light> lights;
+        parse_scene(input, "benchmark", ".", scene, cam, lights);
+        benchmark::DoNotOptimize(scene[0]);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(scene_text.size()));
+}
+BENCHMARK(BM_SceneParse)->RangeMultiplier(32)->Range(1024, 1 << 20)->Unit(benchmark::kMillisecond);
+
+/*
+* One primitive hit by about half of the rays, tested through its virtual intersect. range(0) selects a sphere (0),
+* wall (1), quad (2) or disk (3), all of them intersect with the data prepared at construction.
+*/
+static void BM_PrimitiveIntersect(benchmark::State &state)
+{
+    std::unique_ptr<SceneGeometry> primitive;
+    if (state.range(0) == 0)
+        primitive = std::make_unique<Sphere>(DEFAULT_MATERIAL, point3(3, 0, 0), 1);
+    else if (state.range(0) == 1)
+        primitive = std::make_unique<Wall>(DEFAULT_MATERIAL, point3(3, -1, -1), vec3(-1, 0, 0), 2, 2);
+    else if (state.range(0) == 2)
+        primitive = std::make_unique<Quad>(DEFAULT_MATERIAL, point3(3, -1, -1), vec3(0, 2, 0), vec3(0, 0, 2));
+    else
+        primitive = std::make_unique<Disk>(DEFAULT_MATERIAL, point3(3, 0, 0), vec3(-1, 0, 0), 1);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> spread(-1, 1);
+    std::vector<ray> rays;
+    for (int k = 0; k < 1024; k++)
+        rays.push_back(ray(vec3(3, spread(rng), spread(rng)), point3(0, 0, 0)));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(primitive->intersect(rays[i++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PrimitiveIntersect)->DenseRange(0, 3);
+
+/*
+* range(0) copies of a cluster of 64 spheres, randomly moved, rotated and scaled. range(1) selects a flattened
+* scene with every sphere transformed into world space (0) or one Instance per copy sharing the cluster (1).
+* The memory counter holds the scene, the hierarchy and the shared prototype.
+*/
+static void BM_Instancing(benchmark::State &state)
+{
+    int copies = state.range(0);
+    bool instanced = state.range(1);
+    auto cluster = std::make_shared<Prototype>(random_spheres(64));
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<double> position(-30, 30), axis(-1, 1), angle(0, 2 * M_PI), scale(.02, .06);
+    Scene scene;
+    for (int i = 0; i < copies; i++)
+    {
+        double factor = scale(rng);
+        Transform to_world = Transform::translate(vec3(position(rng), position(rng), position(rng))) *
+                             Transform::rotate(vec3(axis(rng), axis(rng), axis(rng) + 2), angle(rng)) * Transform::scale(factor);
+        if (instanced)
+        {
+            scene.add<Instance>(DEFAULT_MATERIAL, cluster, to_world);
+            continue;
+        }
+        for (SceneGeometry *object : cluster->get_scene())
+        {
+            auto sphere = static_cast<const Sphere *>(object);
+            scene.add<Sphere>(DEFAULT_MATERIAL, to_world.point(sphere->get_center()), sphere->get_radius() * factor);
+        }
+    }
+    BVH bvh(scene);
+    auto rays = random_rays(1024);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bvh.closest_hit(scene, rays[i++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    size_t memory = scene.memory().total() + bvh.memory_size() + (instanced ? cluster->memory_size() : 0);
+    state.counters["memory_MB"] = memory / 1048576.0;
+}
+BENCHMARK(BM_Instancing)->ArgsProduct({{16, 1024, 16384}, {0, 1}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,690 @@
+#include "bvh.h"
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+
+#include "profiler.h"
+
+namespace
+{
+constexpr int SAH_BINS = 12;
+// entries of the traversal stack, the builder stops splitting at STACK_SIZE - 2 so a traversal never needs more
+constexpr int STACK_SIZE = 64;
+// cost of visiting an inner node relative to testing one block of SIMD_WIDTH primitives
+constexpr double TRAVERSAL_COST = 1.;
+
+// primitives in a leaf are tested SIMD_WIDTH at a time, so a leaf costs one test per block
+double blocks(int count)
+{
+    return (count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+}
+
+struct Bin
+{
+    AABB bounds;
+    int count = 0;
+};
+
+bool same_bounds(const AABB &a, const AABB &b)
+{
+    return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+           a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+}
+
+void BVH::build(const Scene &scene)
+{
+    built_revision = scene.structure_revision();
+    std::vector<int> static_objects, dynamic_objects;
+    for (int i = 0; i < static_cast<int>(scene.size()); i++)
+        (scene.is_dynamic(i) ? dynamic_objects : static_objects).push_back(i);
+    build_members(scene, std::move(static_objects));
+    if (dynamic_objects.empty())
+    {
+        dynamic.reset();
+        return;
+    }
+    if (!dynamic)
+        dynamic = std::make_unique<BVH>();
+    dynamic->build_members(scene, std::move(dynamic_objects));
+}
+
+/*
+* Build the tree over a subset of the scene. The per object arrays stay indexed like the scene, growing them only
+* costs time when the scene grew, so rebuilding a tree of a few objects stays cheap in a large scene.
+*/
+void BVH::build_members(const Scene &scene, std::vector<int> objects)
+{
+    nodes.clear();
+    indices.clear();
+    members = std::move(objects);
+    object_bounds.resize(scene.size());
+    object_leaf.resize(scene.size());
+    object_slot.resize(scene.size());
+
+    for (int i : members)
+    {
+        object_bounds[i] = scene[i]->bounds();
+        object_leaf[i] = -1;
+        // objects without bounds can never be hit, so they are left out of the hierarchy
+        if (!object_bounds[i].empty())
+            indices.push_back(i);
+    }
+    if (!indices.empty())
+    {
+        // a binary tree with n leaves never has more than 2n - 1 nodes
+        nodes.reserve(2 * indices.size());
+        BVHNode root;
+        root.left_first = 0;
+        root.count = indices.size();
+        nodes.push_back(root);
+        update_bounds(0);
+        subdivide(0);
+    }
+    pack(scene);
+    build_cost = cost();
+}
+
+/*
+* Copy the primitives into the packed stores, grouped by leaf so every leaf owns a contiguous range per type
+*/
+void BVH::pack(const Scene &scene)
+{
+    spheres.clear();
+    planes.clear();
+    generic.clear();
+    leaf_ranges.assign(nodes.size(), LeafRange());
+    parents.assign(nodes.size(), -1);
+
+    for (int n = 0; n < static_cast<int>(nodes.size()); n++)
+    {
+        if (!nodes[n].is_leaf())
+        {
+            parents[nodes[n].left_first] = n;
+            parents[nodes[n].left_first + 1] = n;
+            continue;
+        }
+        LeafRange &leaf = leaf_ranges[n];
+        leaf.sphere_first = spheres.size();
+        leaf.plane_first = planes.size();
+        leaf.generic_first = generic.size();
+        for (int i = nodes[n].left_first; i < nodes[n].left_first + nodes[n].count; i++)
+        {
+            int index = indices[i];
+            object_leaf[index] = n;
+            object_slot[index] = -1;
+            if (auto sphere = dynamic_cast<const Sphere *>(scene[index]))
+            {
+                object_slot[index] = spheres.size();
+                spheres.add(*sphere, index);
+            }
+            else if (auto plane = dynamic_cast<const PlanarGeometry *>(scene[index]))
+            {
+                object_slot[index] = planes.size();
+                planes.add(*plane, index);
+            }
+            else
+            {
+                generic.push_back(index);
+            }
+        }
+        if (static_cast<int>(spheres.size()) > leaf.sphere_first)
+            spheres.pad();
+        leaf.sphere_count = spheres.size() - leaf.sphere_first;
+        leaf.plane_count = planes.size() - leaf.plane_first;
+        leaf.generic_count = generic.size() - leaf.generic_first;
+    }
+}
+
+void BVH::update_bounds(int node_index)
+{
+    BVHNode &node = nodes[node_index];
+    node.bounds = AABB();
+    for (int i = node.left_first; i < node.left_first + node.count; i++)
+    {
+        node.bounds.expand(object_bounds[indices[i]]);
+    }
+}
+
+/*
+* Evaluate the surface area heuristic for a fixed number of candidate planes per axis
+* and return the cost of the cheapest one
+*/
+double BVH::find_split(const BVHNode &node, int &axis, double &position) const
+{
+    double best_cost = DBL_MAX;
+
+    AABB centroid_bounds;
+    for (int i = node.left_first; i < node.left_first + node.count; i++)
+    {
+        centroid_bounds.expand(object_bounds[indices[i]].centroid());
+    }
+
+    for (int a = 0; a < 3; a++)
+    {
+        double bounds_min = centroid_bounds.min[a];
+        double bounds_max = centroid_bounds.max[a];
+        if (bounds_min == bounds_max)
+            continue;
+
+        Bin bins[SAH_BINS];
+        double scale = SAH_BINS / (bounds_max - bounds_min);
+        for (int i = node.left_first; i < node.left_first + node.count; i++)
+        {
+            const AABB &box = object_bounds[indices[i]];
+            int bin_index = std::min(SAH_BINS - 1, static_cast<int>((box.centroid()[a] - bounds_min) * scale));
+            bins[bin_index].count++;
+            bins[bin_index].bounds.expand(box);
+        }
+
+        // sweep from both sides to get the area and count left and right of every plane between two bins
+        double left_area[SAH_BINS - 1], right_area[SAH_BINS - 1];
+        int left_count[SAH_BINS - 1], right_count[SAH_BINS - 1];
+        AABB left_box, right_box;
+        int left_sum = 0, right_sum = 0;
+        for (int i = 0; i < SAH_BINS - 1; i++)
+        {
+            left_sum += bins[i].count;
+            left_count[i] = left_sum;
+            left_box.expand(bins[i].bounds);
+            left_area[i] = left_box.surface_area();
+
+            right_sum += bins[SAH_BINS - 1 - i].count;
+            right_count[SAH_BINS - 2 - i] = right_sum;
+            right_box.expand(bins[SAH_BINS - 1 - i].bounds);
+            right_area[SAH_BINS - 2 - i] = right_box.surface_area();
+        }
+
+        for (int i = 0; i < SAH_BINS - 1; i++)
+        {
+            double cost = blocks(left_count[i]) * left_area[i] + blocks(right_count[i]) * right_area[i];
+            if (left_count[i] > 0 && right_count[i] > 0 && cost < best_cost)
+            {
+                best_cost = cost;
+                axis = a;
+                position = bounds_min + (i + 1) / scale;
+            }
+        }
+    }
+    return best_cost;
+}
+
+void BVH::subdivide(int node_index, int depth)
+{
+    if (nodes[node_index].count <= 1 || depth >= STACK_SIZE - 2)
+        return;
+
+    int axis = 0;
+    double position = 0;
+    double split_cost = find_split(nodes[node_index], axis, position);
+    double leaf_cost = blocks(nodes[node_index].count) * nodes[node_index].bounds.surface_area();
+    // all centroids coincide, there is nothing to split
+    if (split_cost == DBL_MAX)
+        return;
+    split_cost += TRAVERSAL_COST * nodes[node_index].bounds.surface_area();
+    if (split_cost >= leaf_cost && nodes[node_index].count <= max_leaf_size)
+        return;
+
+    // partition the primitive range around the split plane
+    int first = nodes[node_index].left_first;
+    int count = nodes[node_index].count;
+    auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](int index) {
+        return object_bounds[index].centroid()[axis] < position;
+    });
+    int left_count = static_cast<int>(middle - indices.begin()) - first;
+    if (left_count == 0 || left_count == count)
+        return;
+
+    int left_child = nodes.size();
+    BVHNode left, right;
+    left.left_first = first;
+    left.count = left_count;
+    right.left_first = first + left_count;
+    right.count = count - left_count;
+    nodes.push_back(left);
+    nodes.push_back(right);
+
+    nodes[node_index].left_first = left_child;
+    nodes[node_index].count = 0;
+
+    update_bounds(left_child);
+    update_bounds(left_child + 1);
+    subdivide(left_child, depth + 1);
+    subdivide(left_child + 1, depth + 1);
+}
+
+void BVH::refit(const Scene &scene)
+{
+    for (int index : indices)
+    {
+        object_bounds[index] = scene[index]->bounds();
+    }
+    for (int slot = 0; slot < static_cast<int>(spheres.size()); slot++)
+    {
+        if (spheres.object_index[slot] >= 0)
+            spheres.set(slot, static_cast<const Sphere &>(*scene[spheres.object_index[slot]]));
+    }
+    for (int slot = 0; slot < static_cast<int>(planes.size()); slot++)
+    {
+        planes.set(slot, static_cast<const PlanarGeometry &>(*scene[planes.object_index[slot]]));
+    }
+    // children are always stored after their parent, so walking backwards visits them first
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--)
+    {
+        BVHNode &node = nodes[i];
+        if (node.is_leaf())
+        {
+            update_bounds(i);
+        }
+        else
+        {
+            node.bounds = nodes[node.left_first].bounds;
+            node.bounds.expand(nodes[node.left_first + 1].bounds);
+        }
+    }
+    if (dynamic)
+        dynamic->refit(scene);
+}
+
+bool BVH::refit_members(const Scene &scene, const std::vector<int> &changed)
+{
+    std::vector<int> leaves;
+    for (int index : changed)
+    {
+        object_bounds[index] = scene[index]->bounds();
+        int leaf = object_leaf[index];
+        // an object that had no bounds at the last build has no leaf to go to
+        if (leaf < 0 || object_bounds[index].empty())
+            return false;
+        int slot = object_slot[index];
+        if (slot >= 0)
+        {
+            if (auto sphere = dynamic_cast<const Sphere *>(scene[index]))
+                spheres.set(slot, *sphere);
+            else
+                planes.set(slot, static_cast<const PlanarGeometry &>(*scene[index]));
+        }
+        leaves.push_back(leaf);
+    }
+    // refit every changed leaf and walk up until a node keeps its bounds, the nodes above it already
+    // enclose everything below
+    for (int leaf : leaves)
+    {
+        AABB old_bounds = nodes[leaf].bounds;
+        update_bounds(leaf);
+        for (int n = leaf; n >= 0 && !same_bounds(old_bounds, nodes[n].bounds);)
+        {
+            n = parents[n];
+            if (n < 0)
+                break;
+            old_bounds = nodes[n].bounds;
+            nodes[n].bounds = nodes[nodes[n].left_first].bounds;
+            nodes[n].bounds.expand(nodes[nodes[n].left_first + 1].bounds);
+        }
+    }
+    return true;
+}
+
+bool BVH::update_members(const Scene &scene, const std::vector<int> &changed)
+{
+    if (changed.empty())
+        return false;
+    if (refit_members(scene, changed) && cost() <= build_cost * REBUILD_THRESHOLD)
+        return false;
+    build_members(scene, members);
+    return true;
+}
+
+BVHUpdateStats BVH::update(Scene &scene)
+{
+    BVHUpdateStats stats;
+    stats.refit_objects = scene.dirty().size();
+    if (scene.structure_revision() != built_revision)
+    {
+        // objects were added or removed or changed between static and dynamic
+        build(scene);
+        stats.static_rebuilt = true;
+        stats.dynamic_rebuilt = dynamic != nullptr;
+        stats.refit_objects = 0;
+        scene.clear_dirty();
+        return stats;
+    }
+
+    std::vector<int> static_changed, dynamic_changed;
+    for (int index : scene.dirty())
+        (scene.is_dynamic(index) ? dynamic_changed : static_changed).push_back(index);
+    stats.static_rebuilt = update_members(scene, static_changed);
+    if (dynamic)
+        stats.dynamic_rebuilt = dynamic->update_members(scene, dynamic_changed);
+    scene.clear_dirty();
+    return stats;
+}
+
+double BVH::cost() const
+{
+    if (nodes.empty() || nodes[0].bounds.surface_area() <= 0)
+        return 0;
+    double total = 0;
+    for (const BVHNode &node : nodes)
+        total += (node.is_leaf() ? blocks(node.count) : TRAVERSAL_COST) * node.bounds.surface_area();
+    return total / nodes[0].bounds.surface_area();
+}
+
+AABB BVH::bounds() const
+{
+    AABB box;
+    if (!nodes.empty())
+        box.expand(nodes[0].bounds);
+    if (dynamic)
+        box.expand(dynamic->bounds());
+    return box;
+}
+
+Collision BVH::closest_hit(const Scene &scene, const ray &r) const
+{
+    Collision col = Collision(DBL_MAX, vec3(0, 0, 0), false , -1);
+    ThreadCounters &counters = thread_counters();
+    count(counters.rays, 1);
+    // primitives tested, added to the counters once at the end
+    uint64_t tests = 0;
+    traverse(scene, r, col, tests);
+    if (dynamic)
+        dynamic->traverse(scene, r, col, tests);
+    count(counters.intersection_tests, tests);
+    return col;
+}
+
+Collision BVH::nested_closest_hit(const Scene &scene, const ray &r, uint64_t &tests) const
+{
+    Collision col = Collision(DBL_MAX, vec3(0, 0, 0), false , -1);
+    traverse(scene, r, col, tests);
+    if (dynamic)
+        dynamic->traverse(scene, r, col, tests);
+    return col;
+}
+
+void BVH::traverse(const Scene &scene, const ray &r, Collision &col, uint64_t &tests) const
+{
+    if (nodes.empty())
+        return;
+
+    point3 origin = r.get_origin();
+    vec3 direction = r.get_direction();
+    vec3 inv_direction(1. / direction.x, 1. / direction.y, 1. / direction.z);
+
+    if (nodes[0].bounds.intersect(origin, inv_direction, col.distance) < 0)
+        return;
+
+    // nodes are pushed together with their entry distance so they can be skipped once a closer hit was found
+    int stack[STACK_SIZE];
+    double stack_distance[STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size] = 0;
+    stack_distance[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        stack_size--;
+        if (stack_distance[stack_size] >= col.distance)
+            continue;
+        int node_index = stack[stack_size];
+        const BVHNode &node = nodes[node_index];
+
+        if (node.is_leaf())
+        {
+            const LeafRange &leaf = leaf_ranges[node_index];
+            tests += node.count;
+            double t = col.distance;
+            int slot = spheres.intersect(origin, direction, leaf.sphere_first, leaf.sphere_count, t);
+            if (slot >= 0)
+                col = spheres.collision(r, slot, t);
+            slot = planes.intersect(origin, direction, leaf.plane_first, leaf.plane_count, t);
+            if (slot >= 0)
+                col = planes.collision(slot, t);
+
+            for (int i = leaf.generic_first; i < leaf.generic_first + leaf.generic_count; i++)
+            {
+                Collision object_col = scene[generic[i]]->intersect(r);
+                if (object_col.distance > 0 && object_col.distance < col.distance)
+                {
+                    col = object_col;
+                    col.hit_object_index = generic[i];
+                    col.material = scene[generic[i]]->material_index();
+                }
+            }
+            continue;
+        }
+
+        int near_child = node.left_first;
+        int far_child = node.left_first + 1;
+        double near_distance = nodes[near_child].bounds.intersect(origin, inv_direction, col.distance);
+        double far_distance = nodes[far_child].bounds.intersect(origin, inv_direction, col.distance);
+        if (far_distance >= 0 && (near_distance < 0 || far_distance < near_distance))
+        {
+            std::swap(near_child, far_child);
+            std::swap(near_distance, far_distance);
+        }
+        // push the farther child first so the nearer one is traversed first
+        assert(stack_size + 2 <= STACK_SIZE);
+        if (far_distance >= 0)
+        {
+            stack[stack_size] = far_child;
+            stack_distance[stack_size++] = far_distance;
+        }
+        if (near_distance >= 0)
+        {
+            stack[stack_size] = near_child;
+            stack_distance[stack_size++] = near_distance;
+        }
+    }
+}
+
+bool BVH::occluded(const Scene &scene, const ray &r, double max_distance) const
+{
+    ThreadCounters &counters = thread_counters();
+    count(counters.shadow_rays, 1);
+    uint64_t tests = 0;
+    bool blocked = traverse_any(scene, r, max_distance, tests) || (dynamic && dynamic->traverse_any(scene, r, max_distance, tests));
+    count(counters.intersection_tests, tests);
+    return blocked;
+}
+
+bool BVH::traverse_any(const Scene &scene, const ray &r, double max_distance, uint64_t &tests) const
+{
+    if (nodes.empty())
+        return false;
+
+    point3 origin = r.get_origin();
+    vec3 direction = r.get_direction();
+    vec3 inv_direction(1. / direction.x, 1. / direction.y, 1. / direction.z);
+
+    // any blocker ends the query, so the children are visited without ordering them by distance
+    int stack[STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    bool blocked = false;
+    while (stack_size > 0 && !blocked)
+    {
+        int node_index = stack[--stack_size];
+        const BVHNode &node = nodes[node_index];
+        if (node.bounds.intersect(origin, inv_direction, max_distance) < 0)
+            continue;
+
+        if (node.is_leaf())
+        {
+            const LeafRange &leaf = leaf_ranges[node_index];
+            tests += node.count;
+            double t = max_distance;
+            blocked = spheres.intersect(origin, direction, leaf.sphere_first, leaf.sphere_count, t) >= 0 ||
+                      planes.intersect(origin, direction, leaf.plane_first, leaf.plane_count, t) >= 0;
+            for (int i = leaf.generic_first; i < leaf.generic_first + leaf.generic_count && !blocked; i++)
+            {
+                Collision object_col = scene[generic[i]]->intersect(r);
+                blocked = object_col.distance > 0 && object_col.distance < max_distance;
+            }
+            continue;
+        }
+        assert(stack_size + 2 <= STACK_SIZE);
+        stack[stack_size++] = node.left_first + 1;
+        stack[stack_size++] = node.left_first;
+    }
+    return blocked;
+}
+
+void BVH::closest_hit(const Scene &scene, const RayPacket &packet, Collision *collisions) const
+{
+    alignas(32) double t_max[PACKET_SIZE];
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        collisions[lane] = Collision(DBL_MAX, vec3(0, 0, 0), false , -1);
+        t_max[lane] = DBL_MAX;
+    }
+    if (packet.active == 0)
+        return;
+    ThreadCounters &counters = thread_counters();
+    count(counters.rays, std::bitset<32>(packet.active).count());
+    uint64_t tests = 0;
+    traverse(scene, packet, collisions, t_max, tests);
+    if (dynamic)
+        dynamic->traverse(scene, packet, collisions, t_max, tests);
+    count(counters.intersection_tests, tests);
+}
+
+void BVH::traverse(const Scene &scene, const RayPacket &packet, Collision *collisions, double *t_max, uint64_t &tests) const
+{
+    if (nodes.empty())
+        return;
+    int slot[PACKET_SIZE];
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+        slot[lane] = -1;
+
+    // farthest current hit among the given lanes, a node entered behind it can not contain a closer hit
+    auto farthest_hit = [&](uint32_t lanes) {
+        double farthest = 0;
+        for (int lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            farthest = std::max(farthest, (lanes >> lane) & 1 ? t_max[lane] : 0.);
+        }
+        return farthest;
+    };
+
+    // every stack entry keeps the lanes that entered the node and their closest entry distance
+    int stack[STACK_SIZE];
+    uint32_t stack_lanes[STACK_SIZE];
+    double stack_distance[STACK_SIZE];
+    int stack_size = 0;
+
+    double entry;
+    uint32_t root_lanes = packet.frustum_culls(nodes[0].bounds) ? 0 : packet.intersect(nodes[0].bounds, packet.active, t_max, entry);
+    if (root_lanes == 0)
+        return;
+    stack[stack_size] = 0;
+    stack_lanes[stack_size] = root_lanes;
+    stack_distance[stack_size++] = entry;
+
+    while (stack_size > 0)
+    {
+        stack_size--;
+        int node_index = stack[stack_size];
+        uint32_t lanes = stack_lanes[stack_size];
+        if (stack_distance[stack_size] >= farthest_hit(lanes))
+            continue;
+        const BVHNode &node = nodes[node_index];
+
+        if (node.is_leaf())
+        {
+            const LeafRange &leaf = leaf_ranges[node_index];
+            tests += node.count * std::bitset<32>(lanes).count();
+            if (leaf.sphere_count > 0)
+            {
+                spheres.intersect_packet(packet, lanes, leaf.sphere_first, leaf.sphere_count, t_max, slot);
+                for (int lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    if (slot[lane] >= 0)
+                    {
+                        collisions[lane] = spheres.collision(packet.lane_ray(lane), slot[lane], t_max[lane]);
+                        slot[lane] = -1;
+                    }
+                }
+            }
+            if (leaf.plane_count == 0 && leaf.generic_count == 0)
+                continue;
+            for (int lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                if (!(lanes & (1u << lane)))
+                    continue;
+                ray r = packet.lane_ray(lane);
+                // planes and custom objects are rare enough to be tested one ray at a time
+                int plane_slot = planes.intersect(packet.origin, r.get_direction(), leaf.plane_first, leaf.plane_count, t_max[lane]);
+                if (plane_slot >= 0)
+                    collisions[lane] = planes.collision(plane_slot, t_max[lane]);
+                for (int i = leaf.generic_first; i < leaf.generic_first + leaf.generic_count; i++)
+                {
+                    Collision object_col = scene[generic[i]]->intersect(r);
+                    if (object_col.distance > 0 && object_col.distance < t_max[lane])
+                    {
+                        collisions[lane] = object_col;
+                        collisions[lane].hit_object_index = generic[i];
+                        collisions[lane].material = scene[generic[i]]->material_index();
+                        t_max[lane] = object_col.distance;
+                    }
+                }
+            }
+            continue;
+        }
+
+        int near_child = node.left_first;
+        int far_child = node.left_first + 1;
+        double near_distance, far_distance;
+        uint32_t near_lanes = packet.frustum_culls(nodes[near_child].bounds) ? 0 : packet.intersect(nodes[near_child].bounds, lanes, t_max, near_distance);
+        uint32_t far_lanes = packet.frustum_culls(nodes[far_child].bounds) ? 0 : packet.intersect(nodes[far_child].bounds, lanes, t_max, far_distance);
+        if (far_lanes && (!near_lanes || far_distance < near_distance))
+        {
+            std::swap(near_child, far_child);
+            std::swap(near_lanes, far_lanes);
+            std::swap(near_distance, far_distance);
+        }
+        // push the farther child first so the nearer one is traversed first
+        assert(stack_size + 2 <= STACK_SIZE);
+        if (far_lanes)
+        {
+            stack[stack_size] = far_child;
+            stack_lanes[stack_size] = far_lanes;
+            stack_distance[stack_size++] = far_distance;
+        }
+        if (near_lanes)
+        {
+            stack[stack_size] = near_child;
+            stack_lanes[stack_size] = near_lanes;
+            stack_distance[stack_size++] = near_distance;
+        }
+    }
+}
+
+size_t BVH::memory_size() const
+{
+    return nodes.capacity() * sizeof(BVHNode) + indices.capacity() * sizeof(int) + object_bounds.capacity() * sizeof(AABB) +
+           generic.capacity() * sizeof(int) + leaf_ranges.capacity() * sizeof(LeafRange) + spheres.memory_size() +
+           planes.memory_size() + (members.capacity() + parents.capacity() + object_leaf.capacity() + object_slot.capacity()) * sizeof(int) +
+           (dynamic ? dynamic->memory_size() : 0);
+}
+
+Collision linear_closest_hit(const Scene &scene, const ray &r)
+{
+    // create placeholder collision with highest possible distance and no intersection
+    Collision col = Collision(DBL_MAX, vec3(0, 0, 0), false , -1);
+
+    // check all scene objects for a collision closer to the camera than the current closest collision
+    for (int j = 0; j < static_cast<int>(scene.size()); j++)
+    {
+        Collision object_col = scene[j]->intersect(r);
+
+        if (object_col.distance > 0 && object_col.distance < col.distance)
+        {
+            col = object_col;
+            col.hit_object_index = j;
+            col.material = scene[j]->material_index();
+        }
+    }
+    return col;
+}
@@ -0,0 +1,136 @@
+#ifndef BVH_H
+#define BVH_H
+#include "scene.h"
+#include "packed_primitives.h"
+#include "packet.h"
+#include <memory>
+#include <vector>
+
+/*
+* Node of the flattened hierarchy. Inner nodes store the index of their first child, the second child
+* directly follows it. Leaves store a range in the primitive index list instead.
+*/
+struct BVHNode
+{
+    AABB bounds;
+    int left_first = 0;   // first child for inner nodes, first primitive index for leaves
+    int count = 0;        // number of primitives, 0 for inner nodes
+    bool is_leaf() const { return count > 0; }
+};
+
+/*
+* Primitives of one leaf, split by type into ranges of the packed stores
+*/
+struct LeafRange
+{
+    int sphere_first = 0, sphere_count = 0;
+    int plane_first = 0, plane_count = 0;
+    int generic_first = 0, generic_count = 0;
+};
+
+// what BVH::update did
+struct BVHUpdateStats
+{
+    int refit_objects = 0;
+    bool static_rebuilt = false, dynamic_rebuilt = false;
+};
+
+/*
+* Bounding volume hierarchy over the scene objects, built with binned surface area heuristic splits.
+* Spheres and the planar primitives are copied into packed stores in leaf order and tested with the SIMD kernels,
+* all other SceneGeometry types are tested through their virtual intersect as a slow path.
+* The hierarchy only stores indices into the scene, the scene itself has to outlive it.
+*/
+class BVH
+{
+    std::vector<BVHNode> nodes;
+    std::vector<int> indices;
+    // scene indices of the objects this hierarchy was built over
+    std::vector<int> members;
+    // bounds of the objects while building, indexed like the scene
+    std::vector<AABB> object_bounds;
+
+    PackedSpheres spheres;
+    PackedPlanes planes;
+    // scene indices of the objects without a packed representation
+    std::vector<int> generic;
+    // indexed like nodes, only valid for leaves
+    std::vector<LeafRange> leaf_ranges;
+    // indexed like nodes, -1 for the root
+    std::vector<int> parents;
+    // leaf and packed store slot of every member, indexed like the scene. The slot is -1 for generic objects
+    std::vector<int> object_leaf, object_slot;
+    // cost of the tree right after the last build, see cost()
+    double build_cost = 0;
+    // Scene::structure_revision at the last build
+    unsigned built_revision = 0;
+    // hierarchy of the dynamic objects, nullptr if the scene has none
+    std::unique_ptr<BVH> dynamic;
+
+    void build_members(const Scene &scene, std::vector<int> objects);
+    void pack(const Scene &scene);
+    // depth is that of node_index, the root has depth 0
+    void subdivide(int node_index, int depth = 0);
+    void update_bounds(int node_index);
+    double find_split(const BVHNode &node, int &axis, double &position) const;
+    // refit the leaves holding the given members and their ancestors, false if one of them is not in a leaf
+    bool refit_members(const Scene &scene, const std::vector<int> &changed);
+    // refit, or rebuild when that fails or the tree got too much worse, returns true on a rebuild
+    bool update_members(const Scene &scene, const std::vector<int> &changed);
+
+    // traversal of this tree alone, col and t_max hold the closest hit so far
+    void traverse(const Scene &scene, const ray &r, Collision &col, uint64_t &tests) const;
+    void traverse(const Scene &scene, const RayPacket &packet, Collision *collisions, double *t_max, uint64_t &tests) const;
+    bool traverse_any(const Scene &scene, const ray &r, double max_distance, uint64_t &tests) const;
+
+public:
+    // number of primitives a leaf may hold before the builder tries to split it
+    static constexpr int max_leaf_size = 2 * SIMD_WIDTH;
+    // a refit tree is rebuilt once its cost exceeds the cost after its last build by this factor
+    static constexpr double REBUILD_THRESHOLD = 1.5;
+
+    BVH() {}
+    explicit BVH(const Scene &scene) { build(scene); }
+
+    /*
+    * Build the hierarchy from scratch, needed when objects are added or removed. Objects marked dynamic in the
+    * scene get a second, separate tree, so moving them never touches the tree of the static objects.
+    */
+    void build(const Scene &scene);
+    // recompute all node bounds bottom up after objects moved, keeps the tree topology
+    void refit(const Scene &scene);
+    /*
+    * Bring the hierarchy up to date with the objects marked dirty in the scene and clear the marks. Only the
+    * leaves of the dirty objects and their ancestors are refit, so the cost grows with the number of moved
+    * objects and the depth of their tree. A tree is rebuilt once refitting made it REBUILD_THRESHOLD times as
+    * expensive to traverse as after its last build, the whole hierarchy when objects were added or removed.
+    */
+    BVHUpdateStats update(Scene &scene);
+
+    // closest hit in front of the ray origin, same contract as the linear scan
+    Collision closest_hit(const Scene &scene, const ray &r) const;
+    // closest hits of all active lanes of a packet, written to collisions[lane]
+    void closest_hit(const Scene &scene, const RayPacket &packet, Collision *collisions) const;
+    // closest hit without counting a ray, for hierarchies nested in a scene object, tests counts the primitives tested
+    Collision nested_closest_hit(const Scene &scene, const ray &r, uint64_t &tests) const;
+    // true if anything is hit at a distance in (0, max_distance), stops at the first such hit in any order
+    bool occluded(const Scene &scene, const ray &r, double max_distance) const;
+
+    // bounds of all objects in the hierarchy
+    AABB bounds() const;
+    size_t node_count() const { return nodes.size() + (dynamic ? dynamic->node_count() : 0); }
+    // bytes of the nodes, the build data and the packed primitives
+    size_t memory_size() const;
+    /*
+    * Expected traversal cost by the surface area heuristic relative to a ray through the root, of the static
+    * tree alone. Refitting keeps the topology, so the cost grows as objects move away from where they were built.
+    */
+    double cost() const;
+};
+
+/*
+* Reference implementation that tests every object, used as a baseline for the hierarchy
+*/
+Collision linear_closest_hit(const Scene &scene, const ray &r);
+
+#endif
@@ -0,0 +1,162 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "scene.h"
+#include "bvh.h"
+#include "packet.h"
+
+/*
+* Consistency checks of the render core, run by ctest. Every hit query of the hierarchy is compared against the
+* linear scan of the scene: the closest hit of single rays and packets and the shadow ray query. Prints every
+* mismatch and exits with the number of failed checks.
+*/
+
+namespace
+{
+constexpr int RAYS = 2000;
+constexpr double TOLERANCE = 1e-9;
+
+int failures = 0;
+
+void fail(const char *check, const char *scene_name, int ray_index, const char *detail)
+{
+    if (failures < 20)
+        std::printf("FAIL %s on %s, ray %d: %s\n", check, scene_name, ray_index, detail);
+    failures++;
+}
+
+bool same_hit(const Collision &expected, const Collision &actual)
+{
+    if (expected.hit != actual.hit)
+        return false;
+    if (!expected.hit)
+        return true;
+    return expected.hit_object_index == actual.hit_object_index &&
+           std::abs(expected.distance - actual.distance) <= TOLERANCE * std::max(1., expected.distance);
+}
+
+Scene random_scene(int count, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> position(-10, 10);
+    std::uniform_real_distribution<double> radius(.05, .5);
+    std::uniform_real_distribution<double> unit(-1, 1);
+    Scene scene;
+    for (int i = 0; i < count; i++)
+    {
+        point3 center(position(rng), position(rng), position(rng));
+        if (i % 4 == 3)
+            scene.add<Wall>(DEFAULT_MATERIAL, center, vec3(unit(rng), unit(rng), unit(rng)).normalize(), radius(rng) * 4, radius(rng) * 4);
+        else
+            scene.add<Sphere>(DEFAULT_MATERIAL, center, radius(rng));
+    }
+    return scene;
+}
+
+// spheres doubling their size and distance along a line, the surface area heuristic splits off one sphere per
+// level, so the tree gets as deep as the builder allows
+Scene chain_scene(int count)
+{
+    Scene scene;
+    double x = 1;
+    for (int i = 0; i < count; i++)
+    {
+        scene.add<Sphere>(DEFAULT_MATERIAL, point3(x, 0, 0), x * .1);
+        x *= 2;
+    }
+    return scene;
+}
+
+void check_scene(const char *name, Scene scene, unsigned seed)
+{
+    BVH bvh;
+    bvh.build(scene);
+    AABB bounds = bvh.bounds();
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    auto random_point = [&](double margin) {
+        vec3 extent = bounds.max - bounds.min;
+        return bounds.min - extent * margin + vec3(unit(rng), unit(rng), unit(rng)) * extent * (1 + 2 * margin);
+    };
+    char detail[160];
+
+    // rays from around the scene towards points inside it and one ray at every object from close by, small
+    // objects of a scene with a large extent are hardly hit otherwise
+    int ray_count = RAYS + static_cast<int>(scene.size());
+    for (int i = 0; i < ray_count; i++)
+    {
+        point3 origin = random_point(.2);
+        point3 target = random_point(0);
+        if (i >= RAYS)
+        {
+            AABB object = scene[i - RAYS]->bounds();
+            target = object.centroid();
+            vec3 offset = vec3(unit(rng) - .5, unit(rng) - .5, unit(rng) - .5).normalize();
+            origin = target + offset * (object.max - object.min).length() * 2;
+        }
+        ray r(target - origin, origin);
+        Collision expected = linear_closest_hit(scene, r);
+        Collision actual = bvh.closest_hit(scene, r);
+        if (!same_hit(expected, actual))
+        {
+            std::snprintf(detail, sizeof(detail), "linear hit %d at %g, hierarchy hit %d at %g", expected.hit_object_index,
+                          expected.distance, actual.hit_object_index, actual.distance);
+            fail("closest_hit", name, i, detail);
+        }
+
+        double max_distance = expected.hit ? expected.distance * (unit(rng) < .5 ? .5 : 2) : 1e6;
+        bool blocked = expected.hit && expected.distance < max_distance;
+        if (bvh.occluded(scene, r, max_distance) != blocked)
+        {
+            std::snprintf(detail, sizeof(detail), "linear hit at %g, occluded before %g is %d", expected.distance, max_distance, !blocked);
+            fail("occluded", name, i, detail);
+        }
+    }
+
+    for (int i = 0; i < RAYS / PACKET_SIZE; i++)
+    {
+        RayPacket packet;
+        packet.origin = random_point(.2);
+        // the frustum of a packet is spanned by its corner lanes, so the lanes form a grid like a block of pixels
+        vec3 center = random_point(0) - packet.origin;
+        double spread = center.length() * .02;
+        vec3 delta_x = vec3(unit(rng) - .5, unit(rng) - .5, unit(rng) - .5) * spread;
+        vec3 delta_y = vec3(unit(rng) - .5, unit(rng) - .5, unit(rng) - .5) * spread;
+        for (int lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            packet.set_direction(lane, center + delta_x * (lane % PACKET_WIDTH - 1.5) + delta_y * (lane / PACKET_WIDTH - 1.5));
+            if (unit(rng) < .9)
+                packet.active |= 1u << lane;
+        }
+        packet.finalize();
+        Collision collisions[PACKET_SIZE];
+        bvh.closest_hit(scene, packet, collisions);
+        for (int lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            if (!(packet.active & (1u << lane)))
+                continue;
+            Collision expected = linear_closest_hit(scene, packet.lane_ray(lane));
+            if (!same_hit(expected, collisions[lane]))
+            {
+                std::snprintf(detail, sizeof(detail), "lane %d, linear hit %d at %g, packet hit %d at %g", lane,
+                              expected.hit_object_index, expected.distance, collisions[lane].hit_object_index,
+                              collisions[lane].distance);
+                fail("packet closest_hit", name, i, detail);
+            }
+        }
+    }
+    std::printf("%s: %zu objects, %zu nodes\n", name, scene.size(), bvh.node_count());
+}
+}
+
+int main()
+{
+    check_scene("random 16", random_scene(16, 1), 11);
+    check_scene("random 1000", random_scene(1000, 2), 12);
+    check_scene("random 4000", random_scene(4000, 3), 13);
+    check_scene("chain 300", chain_scene(300), 14);
+    if (failures > 0)
+        std::printf("%d checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
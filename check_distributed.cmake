@@ -0,0 +1,35 @@
+# Renders the same frames in one process and in worker processes and fails unless the files are byte identical.
+# The worker renders run healthy, with every lease backed up at once and with one worker dying while it holds a tile.
+# Run by ctest with RAYTRACER set to the executable and OUTPUT_DIR to a scratch directory.
+set(options --width 160 --height 120 --frames 2 --adaptive 4)
+file(MAKE_DIRECTORY ${OUTPUT_DIR})
+file(REMOVE ${OUTPUT_DIR}/crashed)
+
+execute_process(COMMAND ${RAYTRACER} ${options} --output ${OUTPUT_DIR}/single.pfm RESULT_VARIABLE result OUTPUT_QUIET)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "single process render failed: ${result}")
+endif()
+
+# renders with workers to OUTPUT_DIR/name.pfm, the summary line of the coordinator is stored in output
+function(render_workers name)
+    execute_process(COMMAND ${RAYTRACER} ${options} ${ARGN} --output ${OUTPUT_DIR}/${name}.pfm
+                    RESULT_VARIABLE result OUTPUT_VARIABLE render_output ERROR_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "render ${name} failed: ${result}")
+    endif()
+    foreach(frame 0000 0001)
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT_DIR}/single_${frame}.pfm ${OUTPUT_DIR}/${name}_${frame}.pfm
+                        RESULT_VARIABLE result)
+        if(NOT result EQUAL 0)
+            message(FATAL_ERROR "frame ${frame} differs between the single process and the render ${name}")
+        endif()
+    endforeach()
+    set(output "${render_output}" PARENT_SCOPE)
+endfunction()
+
+render_workers(workers --workers 3)
+render_workers(backed_up --workers 3 --lease-timeout 0)
+render_workers(crashed --workers 3 --crash-worker ${OUTPUT_DIR}/crashed)
+if(NOT EXISTS ${OUTPUT_DIR}/crashed OR NOT output MATCHES " 1 workers failed")
+    message(FATAL_ERROR "no worker died in the render crashed: ${output}")
+endif()
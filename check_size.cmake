@@ -0,0 +1,21 @@
+# Renders images of odd sizes and fails unless the written files have exactly the requested dimensions.
+# Run by ctest with RAYTRACER set to the executable and OUTPUT_DIR to a scratch directory.
+file(MAKE_DIRECTORY ${OUTPUT_DIR})
+
+foreach(size 92x120 101x37 640x479 1x1)
+    string(REPLACE "x" ";" dimensions ${size})
+    list(GET dimensions 0 width)
+    list(GET dimensions 1 height)
+    execute_process(COMMAND ${RAYTRACER} --width ${width} --height ${height} --output ${OUTPUT_DIR}/${size}.ppm
+                    RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "render of ${size} failed: ${result}")
+    endif()
+    file(READ ${OUTPUT_DIR}/${size}.ppm header LIMIT 32)
+    if(NOT header MATCHES "^P6\n([0-9]+) ([0-9]+)\n")
+        message(FATAL_ERROR "${size}.ppm has no PPM header")
+    endif()
+    if(NOT CMAKE_MATCH_1 EQUAL width OR NOT CMAKE_MATCH_2 EQUAL height)
+        message(FATAL_ERROR "requested ${size}, got ${CMAKE_MATCH_1}x${CMAKE_MATCH_2}")
+    endif()
+endforeach()
@@ -0,0 +1,556 @@
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "distributed.h"
+#include "image_io.h"
+#include "profiler.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t LEASE_MAGIC = 0x5341454c;   // "LEAS"
+constexpr uint32_t RESULT_MAGIC = 0x454c4954;  // "TILE"
+// descriptor of the socket in the worker process
+constexpr int WORKER_FD = 3;
+// tiles per worker that may be leased ahead of the first tile not written yet
+constexpr int LEASE_WINDOW = 4;
+
+// coordinator and workers run on the same machine, so messages are plain structs in the native byte order
+struct LeaseMessage
+{
+    uint32_t magic;
+    // a negative frame asks the worker to exit
+    int32_t frame, first_row, rows;
+};
+
+// followed by rows * width * 3 floats, the colors of the tile row by row
+struct ResultHeader
+{
+    uint32_t magic;
+    int32_t frame, first_row, rows, width;
+    int64_t paths, segments;
+    AdaptiveStats adaptive;
+};
+static_assert(std::is_trivially_copyable<ResultHeader>::value, "results are sent as raw bytes");
+
+struct Tile
+{
+    int frame, first_row, rows;
+};
+
+struct Worker
+{
+    pid_t pid = -1;
+    // coordinator end of the socket, -1 once the worker is gone
+    int fd = -1;
+    // leased tile, -1 while idle
+    int tile = -1;
+    Clock::time_point lease_start;
+    // bytes of a result that did not arrive completely yet
+    std::vector<char> received;
+    int tiles_done = 0;
+};
+
+bool read_all(int fd, void *data, size_t size)
+{
+    char *bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t count = read(fd, bytes, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+// the peer may be gone, so no SIGPIPE
+bool send_all(int fd, const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t count = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool spawn_worker(const std::vector<std::string> &command, Worker &worker)
+{
+    int sockets[2];
+    // close on exec, so a worker does not inherit the sockets of the workers started before it
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+        return false;
+    // the render threads are already running, so the child may only make async-signal-safe calls until execv and
+    // must not allocate. The arguments are prepared here
+    std::vector<std::string> args = command;
+    args.push_back("--worker");
+    args.push_back(std::to_string(WORKER_FD));
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(sockets[0]);
+        close(sockets[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        // dup2 clears the close on exec flag of the copy, but does nothing if the socket already is WORKER_FD
+        if (sockets[1] == WORKER_FD)
+            fcntl(WORKER_FD, F_SETFD, 0);
+        else
+            dup2(sockets[1], WORKER_FD);
+        // the scene statistics of the workers would repeat those of the coordinator
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+            dup2(null, STDOUT_FILENO);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    close(sockets[1]);
+    fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+    worker.pid = pid;
+    worker.fd = sockets[0];
+    return true;
+}
+
+// ask an idle worker to exit or kill a busy one and wait for it, a worker that does not read the message exits
+// when the socket is closed
+void stop_worker(Worker &worker, bool kill_worker)
+{
+    if (kill_worker)
+    {
+        kill(worker.pid, SIGKILL);
+    }
+    else
+    {
+        LeaseMessage exit{LEASE_MAGIC, -1, 0, 0};
+        send_all(worker.fd, &exit, sizeof(exit));
+    }
+    close(worker.fd);
+    worker.fd = -1;
+    waitpid(worker.pid, nullptr, 0);
+}
+
+class Coordinator
+{
+    const OfflineOptions &options;
+    const DistributedOptions &distributed;
+    int width, height;
+    std::vector<Tile> tiles;
+    std::vector<Worker> workers;
+
+    // per tile: result arrived, number of workers currently holding a lease
+    std::vector<char> done;
+    std::vector<int> holders;
+    // results waiting for a tile above them, by tile index
+    std::map<int, std::vector<float>> finished;
+    // tiles of failed workers, leased before any new tile
+    std::deque<int> requeued;
+    size_t next_tile = 0, next_write = 0;
+    int releases = 0, failures = 0;
+
+    // output of the frame being written
+    std::unique_ptr<ImageWriter> writer;
+    std::string path;
+    Framebuffer band;
+    Clock::time_point frame_start;
+    // statistics by frame, tiles of the next frame may arrive before a frame is written
+    std::vector<RenderStats> frame_stats;
+    std::vector<AdaptiveStats> frame_adaptive;
+
+    int next_lease(Clock::time_point now);
+    void lease(Worker &worker, int tile);
+    void fail(Worker &worker, const char *reason);
+    bool receive(Worker &worker);
+    bool write_finished();
+    int poll_timeout(Clock::time_point now) const;
+
+public:
+    Coordinator(const Camera &cam, const OfflineOptions &options, const DistributedOptions &distributed);
+    ~Coordinator();
+    int run(const std::vector<std::string> &command);
+};
+
+Coordinator::Coordinator(const Camera &cam, const OfflineOptions &options, const DistributedOptions &distributed)
+    : options{options}, distributed{distributed}, width{static_cast<int>(cam.image_width)},
+      height{static_cast<int>(cam.image_height)}, band(width, BAND_HEIGHT, band_precision(options))
+{
+    // moving the camera between frames does not change the image size
+    for (int frame = 0; frame < options.frames; frame++)
+        for (int first_row = 0; first_row < height; first_row += BAND_HEIGHT)
+            tiles.push_back({frame, first_row, std::min(BAND_HEIGHT, height - first_row)});
+    done.assign(tiles.size(), 0);
+    holders.assign(tiles.size(), 0);
+    frame_stats.resize(options.frames);
+    frame_adaptive.resize(options.frames);
+}
+
+Coordinator::~Coordinator()
+{
+    // busy workers may still render a backed up tile whose result is not needed
+    for (Worker &worker : workers)
+    {
+        if (worker.fd >= 0)
+            stop_worker(worker, worker.tile >= 0);
+    }
+}
+
+int Coordinator::next_lease(Clock::time_point now)
+{
+    while (!requeued.empty())
+    {
+        int tile = requeued.front();
+        requeued.pop_front();
+        if (!done[tile])
+            return tile;
+    }
+    if (next_tile < tiles.size() && next_tile < next_write + LEASE_WINDOW * workers.size())
+        return static_cast<int>(next_tile++);
+    // back up the oldest lease that ran out with a second worker, the first result wins
+    Worker *oldest = nullptr;
+    auto timeout = std::chrono::duration<double>(distributed.lease_timeout);
+    for (Worker &worker : workers)
+    {
+        if (worker.fd >= 0 && worker.tile >= 0 && !done[worker.tile] && holders[worker.tile] == 1 && now - worker.lease_start > timeout &&
+            (!oldest || worker.lease_start < oldest->lease_start))
+            oldest = &worker;
+    }
+    if (!oldest)
+        return -1;
+    releases++;
+    return oldest->tile;
+}
+
+void Coordinator::lease(Worker &worker, int tile)
+{
+    worker.tile = tile;
+    worker.lease_start = Clock::now();
+    holders[tile]++;
+    LeaseMessage message{LEASE_MAGIC, tiles[tile].frame, tiles[tile].first_row, tiles[tile].rows};
+    if (!send_all(worker.fd, &message, sizeof(message)))
+        fail(worker, "stopped accepting tiles");
+}
+
+void Coordinator::fail(Worker &worker, const char *reason)
+{
+    std::cerr << "Worker " << worker.pid << " " << reason;
+    failures++;
+    if (worker.tile >= 0)
+    {
+        int tile = worker.tile;
+        worker.tile = -1;
+        holders[tile]--;
+        if (!done[tile] && holders[tile] == 0)
+        {
+            requeued.push_front(tile);
+            std::cerr << ", frame " << tiles[tile].frame << " rows " << tiles[tile].first_row << " to "
+                      << tiles[tile].first_row + tiles[tile].rows - 1 << " are leased again";
+        }
+    }
+    std::cerr << std::endl;
+    stop_worker(worker, true);
+}
+
+bool Coordinator::receive(Worker &worker)
+{
+    char buffer[64 * 1024];
+    for (;;)
+    {
+        ssize_t count = read(worker.fd, buffer, sizeof(buffer));
+        if (count > 0)
+        {
+            worker.received.insert(worker.received.end(), buffer, buffer + count);
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        fail(worker, "exited");
+        return false;
+    }
+    if (worker.received.size() < sizeof(ResultHeader))
+        return true;
+    ResultHeader header;
+    memcpy(&header, worker.received.data(), sizeof(header));
+    // a worker only ever holds one lease, anything else is a broken worker
+    if (header.magic != RESULT_MAGIC || worker.tile < 0 || header.width != width ||
+        header.frame != tiles[worker.tile].frame || header.first_row != tiles[worker.tile].first_row ||
+        header.rows != tiles[worker.tile].rows)
+    {
+        fail(worker, "sent an invalid result");
+        return false;
+    }
+    size_t pixel_count = static_cast<size_t>(header.rows) * width * 3;
+    size_t size = sizeof(header) + pixel_count * sizeof(float);
+    if (worker.received.size() < size)
+        return true;
+
+    int tile = worker.tile;
+    worker.tile = -1;
+    worker.tiles_done++;
+    holders[tile]--;
+    // the slower of two workers holding a backed up lease delivers a duplicate
+    if (!done[tile])
+    {
+        done[tile] = 1;
+        std::vector<float> &pixels = finished[tile];
+        pixels.resize(pixel_count);
+        memcpy(pixels.data(), worker.received.data() + sizeof(header), pixel_count * sizeof(float));
+        RenderStats &stats = frame_stats[header.frame];
+        stats.paths += header.paths;
+        stats.segments += header.segments;
+        AdaptiveStats &adaptive = frame_adaptive[header.frame];
+        adaptive.primary_rays += header.adaptive.primary_rays;
+        adaptive.extra_rays += header.adaptive.extra_rays;
+        adaptive.budget_rays += header.adaptive.budget_rays;
+        adaptive.edge_pixels += header.adaptive.edge_pixels;
+        adaptive.refined_pixels += header.adaptive.refined_pixels;
+        adaptive.segments += header.adaptive.segments;
+    }
+    worker.received.erase(worker.received.begin(), worker.received.begin() + size);
+    return true;
+}
+
+// write the finished tiles that directly follow the written ones, false on I/O errors
+bool Coordinator::write_finished()
+{
+    while (next_write < tiles.size() && done[next_write])
+    {
+        PROFILE_STAGE("write band");
+        const Tile &tile = tiles[next_write];
+        if (tile.first_row == 0)
+        {
+            path = frame_path(options.output, tile.frame, options.frames);
+            writer = open_image_writer(path, width, height);
+            if (!writer)
+                return false;
+        }
+        const std::vector<float> &pixels = finished[next_write];
+        for (int i = 0; i < tile.rows; i++)
+        {
+            const float *row = &pixels[static_cast<size_t>(i) * width * 3];
+            for (int j = 0; j < width; j++)
+                band.set(i, j, RGB(row[3 * j], row[3 * j + 1], row[3 * j + 2]));
+            if (!writer->write_row(band, i))
+            {
+                std::cerr << "Writing " << path << " failed" << std::endl;
+                return false;
+            }
+        }
+        finished.erase(next_write);
+        next_write++;
+        if (tile.first_row + tile.rows < height)
+            continue;
+
+        if (!writer->finish())
+        {
+            std::cerr << "Writing " << path << " failed" << std::endl;
+            return false;
+        }
+        writer.reset();
+        auto end_time = Clock::now();
+        std::cout << path << ": " << width << "x" << height << " in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - frame_start).count() << " ms, "
+                  << frame_stats[tile.frame].average_bounces() << " ray segments per path\n";
+        if (options.adaptive && options.samples <= 1)
+        {
+            const AdaptiveStats &adaptive = frame_adaptive[tile.frame];
+            std::cout << "   adaptive anti-aliasing: " << adaptive.refined_pixels << " of " << adaptive.edge_pixels << " edge pixels refined, "
+                      << adaptive.extra_rays << " extra rays (budget " << adaptive.budget_rays << ") on "
+                      << adaptive.primary_rays << " primary rays\n";
+        }
+        frame_start = end_time;
+    }
+    return true;
+}
+
+// milliseconds until the next lease runs out while a worker is idle to back it up, -1 waits for results only
+int Coordinator::poll_timeout(Clock::time_point now) const
+{
+    bool idle = false;
+    for (const Worker &worker : workers)
+        idle |= worker.fd >= 0 && worker.tile < 0;
+    if (!idle)
+        return -1;
+    int timeout = -1;
+    auto lease_timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(distributed.lease_timeout));
+    for (const Worker &worker : workers)
+    {
+        if (worker.fd < 0 || worker.tile < 0 || done[worker.tile] || holders[worker.tile] != 1)
+            continue;
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(worker.lease_start + lease_timeout - now).count();
+        int wait = static_cast<int>(std::max<long long>(remaining + 1, 0));
+        timeout = timeout < 0 ? wait : std::min(timeout, wait);
+    }
+    return timeout;
+}
+
+int Coordinator::run(const std::vector<std::string> &command)
+{
+    workers.resize(distributed.workers);
+    for (Worker &worker : workers)
+    {
+        if (!spawn_worker(command, worker))
+        {
+            std::cerr << "Starting a worker failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+    auto start_time = Clock::now();
+    frame_start = start_time;
+    std::vector<pollfd> polled;
+    std::vector<Worker *> polled_workers;
+    while (next_write < tiles.size())
+    {
+        auto now = Clock::now();
+        for (Worker &worker : workers)
+        {
+            if (worker.fd < 0 || worker.tile >= 0)
+                continue;
+            int tile = next_lease(now);
+            if (tile < 0)
+                break;
+            lease(worker, tile);
+        }
+        polled.clear();
+        polled_workers.clear();
+        for (Worker &worker : workers)
+        {
+            if (worker.fd < 0)
+                continue;
+            polled.push_back({worker.fd, POLLIN, 0});
+            polled_workers.push_back(&worker);
+        }
+        if (polled.empty())
+        {
+            std::cerr << "All workers failed" << std::endl;
+            return 1;
+        }
+        if (poll(polled.data(), polled.size(), poll_timeout(now)) < 0 && errno != EINTR)
+        {
+            std::cerr << "Waiting for the workers failed: " << strerror(errno) << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < polled.size(); i++)
+        {
+            if (polled[i].revents)
+                receive(*polled_workers[i]);
+        }
+        if (!write_finished())
+            return 1;
+    }
+    auto end_time = Clock::now();
+    std::cout << tiles.size() << " tiles rendered by " << workers.size() << " workers in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << " ms, "
+              << releases << " leases backed up after " << distributed.lease_timeout << " s, " << failures << " workers failed\n";
+    if (options.profile)
+    {
+        for (const Worker &worker : workers)
+            std::cout << "   worker " << worker.pid << ": " << worker.tiles_done << " tiles" << (worker.fd < 0 ? ", failed" : "") << "\n";
+    }
+    return 0;
+}
+}
+
+int render_distributed(const std::vector<std::string> &command, Camera cam,
+                       const OfflineOptions &options, const DistributedOptions &distributed)
+{
+    cam.init();
+    Coordinator coordinator(cam, options, distributed);
+    return coordinator.run(command);
+}
+
+int run_worker(int fd, const Scene &scene, const BVH &bvh, Camera cam,
+               ThreadPool &pool, const RenderSettings &settings, const OfflineOptions &options,
+               const DistributedOptions &distributed)
+{
+    // the camera moves between frames like in render_offline, so frame n is reached from the first frame
+    const Camera first = cam;
+    int frame = 0;
+    auto u = cam.init();
+    int width = static_cast<int>(cam.image_width);
+    Framebuffer band(width, BAND_HEIGHT, band_precision(options));
+    std::vector<char> message;
+    LeaseMessage lease;
+    while (read_all(fd, &lease, sizeof(lease)))
+    {
+        if (lease.magic != LEASE_MAGIC || lease.rows > BAND_HEIGHT)
+        {
+            std::cerr << "Invalid lease from the coordinator" << std::endl;
+            return 1;
+        }
+        if (lease.frame < 0)
+            break;
+        // O_EXCL lets exactly one worker of the render die
+        if (!distributed.crash_file.empty() && open(distributed.crash_file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644) >= 0)
+            _exit(1);
+        if (lease.frame < frame)
+        {
+            cam = first;
+            frame = 0;
+        }
+        for (; frame < lease.frame; frame++)
+        {
+            cam.init();
+            cam.forward();
+        }
+        u = cam.init();
+
+        ResultHeader header{};
+        header.magic = RESULT_MAGIC;
+        header.frame = lease.frame;
+        header.first_row = lease.first_row;
+        header.rows = lease.rows;
+        header.width = width;
+        RenderStats stats = render_band(u, scene, bvh, cam, band, pool, settings, options, lease.first_row, lease.rows, header.adaptive);
+        header.paths = stats.paths;
+        header.segments = stats.segments;
+
+        message.resize(sizeof(header) + static_cast<size_t>(lease.rows) * width * 3 * sizeof(float));
+        memcpy(message.data(), &header, sizeof(header));
+        float *pixels = reinterpret_cast<float *>(message.data() + sizeof(header));
+        for (int i = 0; i < lease.rows; i++)
+        {
+            for (int j = 0; j < width; j++)
+            {
+                RGB color = band.get(i, j);
+                *pixels++ = static_cast<float>(color.x);
+                *pixels++ = static_cast<float>(color.y);
+                *pixels++ = static_cast<float>(color.z);
+            }
+        }
+        if (!send_all(fd, message.data(), message.size()))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+#include <string>
+#include <vector>
+
+#include "offline.h"
+
+struct DistributedOptions
+{
+    // worker processes started by the coordinator, 0 renders in this process
+    int workers = 0;
+    // seconds a worker may hold a tile before it is leased to an idle worker as well
+    double lease_timeout = 30;
+    // test hook, the first worker leased a tile while this file does not exist creates it and exits without a result
+    std::string crash_file;
+};
+
+/*
+* Coordinator of a distributed offline render. Every frame is split into tiles of BAND_HEIGHT full rows that are
+* leased one at a time to worker processes started from command (the path of the executable is taken from
+* /proc/self/exe, command[0] is only passed on as the program name) with "--worker 3" appended. Each worker gets
+* one end of a Unix socket pair as descriptor 3 and renders the scene of its own command line.
+* Finished tiles are written in order as soon as all tiles above them arrived, so memory is bounded by the tiles
+* leased ahead of the first missing one. The tile of a worker that died goes back to the queue, a tile held
+* longer than the lease timeout is leased to an idle worker as well and the first result wins. Every pixel is
+* traced the same way as by render_offline, so the output is bit identical for any number of workers.
+* Returns the process exit code.
+*/
+int render_distributed(const std::vector<std::string> &command, Camera cam,
+                       const OfflineOptions &options, const DistributedOptions &distributed);
+
+/*
+* Worker side, renders the tiles leased over the socket fd until the coordinator sends a lease with a negative
+* frame or closes the socket.
+* Returns the process exit code.
+*/
+int run_worker(int fd, const Scene &scene, const BVH &bvh, Camera cam,
+               ThreadPool &pool, const RenderSettings &settings, const OfflineOptions &options,
+               const DistributedOptions &distributed);
+
+#endif
@@ -0,0 +1,101 @@
+#include "frame_pipeline.h"
+#include <algorithm>
+
+#include "profiler.h"
+
+FramePipeline::FramePipeline(int buffer_count, int width, int height, PixelPrecision precision, RenderFunction render)
+    : slots(std::max(buffer_count, 2)), render{std::move(render)}
+{
+    for (auto &slot : slots)
+    {
+        slot.buffer = Framebuffer(width, height, precision);
+    }
+    render_thread = std::thread(&FramePipeline::render_loop, this);
+}
+
+FramePipeline::~FramePipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    render_thread.join();
+}
+
+void FramePipeline::render_loop()
+{
+    Profiler::get().set_thread_name("frame pipeline");
+    while (true)
+    {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&] { return stop || !render_queue.empty(); });
+            if (stop)
+                return;
+            slot = render_queue.front();
+            render_queue.pop_front();
+            rendering = slot;
+        }
+
+        // the slot is owned by this thread until it is marked done
+        {
+            PROFILE_STAGE("trace frame");
+            render(slots[slot].cam, slots[slot].buffer);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[slot].state = SlotState::Done;
+            rendering = -1;
+            present_queue.push_back(slot);
+        }
+        condition.notify_all();
+    }
+}
+
+bool FramePipeline::submit(const Camera &cam)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int free_slot = -1;
+        for (int i = 0; i < static_cast<int>(slots.size()); i++)
+        {
+            if (slots[i].state == SlotState::Free)
+            {
+                free_slot = i;
+                break;
+            }
+        }
+        if (free_slot < 0)
+            return false;
+        slots[free_slot].cam = cam;
+        slots[free_slot].state = SlotState::Queued;
+        render_queue.push_back(free_slot);
+    }
+    condition.notify_all();
+    return true;
+}
+
+const Framebuffer *FramePipeline::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&] { return !present_queue.empty() || (render_queue.empty() && rendering < 0); });
+    if (present_queue.empty())
+        return nullptr;
+    presenting = present_queue.front();
+    present_queue.pop_front();
+    slots[presenting].state = SlotState::Presenting;
+    return &slots[presenting].buffer;
+}
+
+void FramePipeline::release()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (presenting >= 0)
+    {
+        slots[presenting].state = SlotState::Free;
+        presenting = -1;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scene.h"
+#include "framebuffer.h"
+
+/*
+* Ring of frame buffers rendered on a dedicated thread, so tracing frame N+1 overlaps with presenting frame N.
+* submit() queues a frame with a snapshot of the camera, acquire() waits for the oldest queued frame and
+* release() hands its buffer back once it was presented. With two buffers one frame is traced while the
+* other is presented, a third buffer lets the render thread start another frame while presentation is slow.
+*/
+class FramePipeline
+{
+public:
+    using RenderFunction = std::function<void(const Camera &, Framebuffer &)>;
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Queued,
+        Done,
+        Presenting
+    };
+
+    struct Slot
+    {
+        Framebuffer buffer;
+        Camera cam;
+        SlotState state = SlotState::Free;
+    };
+
+    std::vector<Slot> slots;
+    // slots waiting for the render thread and finished slots waiting to be presented, in submission order
+    std::deque<int> render_queue, present_queue;
+    int rendering = -1;
+    int presenting = -1;
+    bool stop = false;
+
+    RenderFunction render;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread render_thread;
+
+    void render_loop();
+
+public:
+    FramePipeline(int buffer_count, int width, int height, PixelPrecision precision, RenderFunction render);
+    ~FramePipeline();
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    int buffer_count() const { return slots.size(); }
+
+    // queue a frame seen from cam, returns false without queueing if every buffer is in use
+    bool submit(const Camera &cam);
+    // block until the oldest submitted frame is finished, nullptr if no frame was submitted
+    const Framebuffer *acquire();
+    // return the buffer of the last acquired frame
+    void release();
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "framebuffer.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE4_1__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+// rows converted by one task when the conversion is spread over the pool
+constexpr int CONVERT_ROWS = 32;
+
+uint16_t float_to_half(float value)
+{
+#if defined(__F16C__)
+    return _cvtss_sh(value, 0);
+#else
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (((bits >> 23) & 0xFF) == 0xFF)
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31)
+        return sign | 0x7C00;
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return sign;
+        // denormal half, shift the mantissa including the implicit leading one
+        mantissa |= 0x800000;
+        return sign | static_cast<uint16_t>((mantissa >> (14 - exponent)) + ((mantissa >> (13 - exponent)) & 1));
+    }
+    // round to nearest, a carry into the exponent is the correct result
+    return sign | static_cast<uint16_t>(((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+#endif
+}
+
+float half_to_float(uint16_t value)
+{
+#if defined(__F16C__)
+    return _cvtsh_ss(value);
+#else
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F)
+    {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent == 0)
+    {
+        float result = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -result : result;
+    }
+    else
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+#endif
+}
+
+float display_value(float value, const DisplaySettings &display)
+{
+    if (display.tone_mapping == ToneMapping::Reinhard)
+        value = std::max(value, 0.f) / (1 + std::max(value, 0.f));
+    value = std::clamp(value, 0.f, 1.f);
+    if (display.gamma)
+        value = std::sqrt(value);
+    return value;
+}
+}
+
+Framebuffer::Framebuffer(int width, int height, PixelPrecision precision) : precision{precision}
+{
+    resize(width, height);
+}
+
+void Framebuffer::resize(int new_width, int new_height)
+{
+    width = new_width;
+    height = new_height;
+    size_t channels = static_cast<size_t>(width) * height * 4;
+    if (precision == PixelPrecision::Float)
+        float_data.assign(channels, 0.f);
+    else
+        half_data.assign(channels, 0);
+}
+
+size_t Framebuffer::memory_size() const
+{
+    return float_data.size() * sizeof(float) + half_data.size() * sizeof(uint16_t);
+}
+
+void Framebuffer::set(int row, int column, const RGB &color)
+{
+    size_t index = (static_cast<size_t>(row) * width + column) * 4;
+    if (precision == PixelPrecision::Float)
+    {
+        float_data[index] = color.x;
+        float_data[index + 1] = color.y;
+        float_data[index + 2] = color.z;
+        float_data[index + 3] = 1.f;
+    }
+    else
+    {
+        half_data[index] = float_to_half(color.x);
+        half_data[index + 1] = float_to_half(color.y);
+        half_data[index + 2] = float_to_half(color.z);
+        half_data[index + 3] = float_to_half(1.f);
+    }
+}
+
+void Framebuffer::accumulate(int row, int column, const RGB &color, double weight)
+{
+    if (weight >= 1)
+    {
+        set(row, column, color);
+        return;
+    }
+    RGB mean = get(row, column);
+    set(row, column, mean + (color - mean) * weight);
+}
+
+void Framebuffer::copy_from(const Framebuffer &source)
+{
+    if (source.width != width || source.height != height)
+        resize(source.width, source.height);
+    if (source.precision == precision)
+    {
+        float_data = source.float_data;
+        half_data = source.half_data;
+        return;
+    }
+    for (int row = 0; row < height; row++)
+    {
+        for (int column = 0; column < width; column++)
+        {
+            set(row, column, source.get(row, column));
+        }
+    }
+}
+
+void Framebuffer::upscale_from(const Framebuffer &source, ThreadPool &pool)
+{
+    // the taps of a column are the same in every row, the pixel centers of this buffer in source pixels
+    std::vector<int> left(width), right(width);
+    std::vector<float> weight(width);
+    double ratio_x = static_cast<double>(source.width) / width, ratio_y = static_cast<double>(source.height) / height;
+    for (int column = 0; column < width; column++)
+    {
+        double x = std::clamp((column + .5) * ratio_x - .5, 0., source.width - 1.);
+        left[column] = static_cast<int>(x);
+        right[column] = std::min(left[column] + 1, source.width - 1);
+        weight[column] = static_cast<float>(x - left[column]);
+    }
+    bool floats = precision == PixelPrecision::Float && source.precision == PixelPrecision::Float;
+    pool.parallel_for((height + CONVERT_ROWS - 1) / CONVERT_ROWS, [&](int task, int) {
+        for (int row = task * CONVERT_ROWS; row < std::min((task + 1) * CONVERT_ROWS, height); row++)
+        {
+            double y = std::clamp((row + .5) * ratio_y - .5, 0., source.height - 1.);
+            int top = static_cast<int>(y), bottom = std::min(top + 1, source.height - 1);
+            float fy = static_cast<float>(y - top);
+            if (!floats)
+            {
+                for (int column = 0; column < width; column++)
+                {
+                    float fx = weight[column];
+                    RGB upper = source.get(top, left[column]) * (1 - fx) + source.get(top, right[column]) * fx;
+                    RGB lower = source.get(bottom, left[column]) * (1 - fx) + source.get(bottom, right[column]) * fx;
+                    set(row, column, upper * (1 - fy) + lower * fy);
+                }
+                continue;
+            }
+            const float *upper = &source.float_data[static_cast<size_t>(top) * source.width * 4];
+            const float *lower = &source.float_data[static_cast<size_t>(bottom) * source.width * 4];
+            float *out = &float_data[static_cast<size_t>(row) * width * 4];
+            for (int column = 0; column < width; column++)
+            {
+                float fx = weight[column];
+                const float *a = upper + left[column] * 4, *b = upper + right[column] * 4;
+                const float *c = lower + left[column] * 4, *d = lower + right[column] * 4;
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    float first = a[channel] + (b[channel] - a[channel]) * fx;
+                    float second = c[channel] + (d[channel] - c[channel]) * fx;
+                    out[column * 4 + channel] = first + (second - first) * fy;
+                }
+            }
+        }
+    });
+}
+
+double Framebuffer::mean_difference(const Framebuffer &other) const
+{
+    double sum = 0;
+    for (int row = 0; row < height; row++)
+    {
+        for (int column = 0; column < width; column++)
+        {
+            RGB difference = get(row, column) - other.get(row, column);
+            sum += std::fabs(difference.x) + std::fabs(difference.y) + std::fabs(difference.z);
+        }
+    }
+    return width * height > 0 ? sum / (3.0 * width * height) : 0;
+}
+
+RGB Framebuffer::get(int row, int column) const
+{
+    size_t index = (static_cast<size_t>(row) * width + column) * 4;
+    if (precision == PixelPrecision::Float)
+        return RGB(float_data[index], float_data[index + 1], float_data[index + 2]);
+    return RGB(half_to_float(half_data[index]), half_to_float(half_data[index + 1]), half_to_float(half_data[index + 2]));
+}
+
+void Framebuffer::convert_rgba8(void *destination, int pitch, const PixelLayout &layout, const DisplaySettings &display,
+                                int first_row, int row_count) const
+{
+    int shifts[4] = {layout.red_shift, layout.green_shift, layout.blue_shift, layout.alpha_shift};
+
+#if defined(__SSE4_1__)
+    // byte shuffle from r, g, b, a order to the destination layout, four pixels at a time
+    alignas(16) int8_t order[16];
+    for (int pixel = 0; pixel < 4; pixel++)
+    {
+        for (int channel = 0; channel < 4; channel++)
+        {
+            order[pixel * 4 + shifts[channel] / 8] = pixel * 4 + channel;
+        }
+    }
+    __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(order));
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 scale = _mm_set1_ps(255.f);
+#endif
+
+    for (int row = first_row; row < first_row + row_count; row++)
+    {
+        uint32_t *out = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(destination) + static_cast<size_t>(row - first_row) * pitch);
+        size_t row_start = static_cast<size_t>(row) * width * 4;
+        int column = 0;
+
+#if defined(__SSE4_1__)
+        for (; column + 4 <= width; column += 4)
+        {
+            __m128i channels[4];
+            for (int pixel = 0; pixel < 4; pixel++)
+            {
+                size_t index = row_start + (column + pixel) * 4;
+                __m128 value;
+#if defined(__F16C__)
+                if (precision == PixelPrecision::Half)
+                    value = _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&half_data[index])));
+                else
+#else
+                if (precision == PixelPrecision::Half)
+                    value = _mm_setr_ps(half_to_float(half_data[index]), half_to_float(half_data[index + 1]),
+                                        half_to_float(half_data[index + 2]), 1.f);
+                else
+#endif
+                    value = _mm_loadu_ps(&float_data[index]);
+
+                if (display.tone_mapping == ToneMapping::Reinhard)
+                {
+                    value = _mm_max_ps(value, zero);
+                    value = _mm_div_ps(value, _mm_add_ps(one, value));
+                }
+                value = _mm_min_ps(_mm_max_ps(value, zero), one);
+                if (display.gamma)
+                    value = _mm_sqrt_ps(value);
+                // the padding channel becomes an opaque alpha
+                value = _mm_blend_ps(value, one, 0x8);
+                channels[pixel] = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+            }
+            __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(channels[0], channels[1]), _mm_packus_epi32(channels[2], channels[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + column), _mm_shuffle_epi8(bytes, shuffle));
+        }
+#endif
+        for (; column < width; column++)
+        {
+            RGB color = get(row, column);
+            // round half to even like _mm_cvtps_epi32, so a color gives the same bytes in every column
+            uint32_t red = static_cast<uint32_t>(std::lrintf(display_value(color.x, display) * 255.f));
+            uint32_t green = static_cast<uint32_t>(std::lrintf(display_value(color.y, display) * 255.f));
+            uint32_t blue = static_cast<uint32_t>(std::lrintf(display_value(color.z, display) * 255.f));
+            out[column] = red << shifts[0] | green << shifts[1] | blue << shifts[2] | 255u << shifts[3];
+        }
+    }
+}
+
+void Framebuffer::convert_rgba8(void *destination, int pitch, const PixelLayout &layout, const DisplaySettings &display, ThreadPool &pool) const
+{
+    int tasks = (height + CONVERT_ROWS - 1) / CONVERT_ROWS;
+    pool.parallel_for(tasks, [&](int task, int) {
+        int first_row = task * CONVERT_ROWS;
+        int rows = std::min(CONVERT_ROWS, height - first_row);
+        convert_rgba8(static_cast<uint8_t *>(destination) + static_cast<size_t>(first_row) * pitch, pitch, layout, display, first_row, rows);
+    });
+}
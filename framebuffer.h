@@ -0,0 +1,84 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+#include <cstdint>
+#include <vector>
+
+#include "vec.h"
+
+class ThreadPool;
+
+// storage format of the accumulated colors
+enum class PixelPrecision
+{
+    Float,  // 32 bit float per channel
+    Half    // 16 bit float per channel, half the memory and bandwidth
+};
+
+enum class ToneMapping
+{
+    Clamp,    // clamp to [0, 1], the look of the original renderer
+    Reinhard  // c / (1 + c), compresses highlights instead of clipping them
+};
+
+/*
+* Bit positions of the channels in a 32 bit pixel, i.e. the shifts of the SDL surface masks
+*/
+struct PixelLayout
+{
+    int red_shift = 24, green_shift = 16, blue_shift = 8, alpha_shift = 0;
+};
+
+/*
+* Display settings applied when converting to 8 bit
+*/
+struct DisplaySettings
+{
+    ToneMapping tone_mapping = ToneMapping::Clamp;
+    // apply a gamma of 2 (square root) after tone mapping
+    bool gamma = false;
+};
+
+/*
+* Contiguous row-major frame buffer with four channels per pixel (the fourth channel is padding, so every
+* pixel is one SIMD register in float mode).
+*/
+class Framebuffer
+{
+    int width = 0, height = 0;
+    PixelPrecision precision = PixelPrecision::Float;
+    std::vector<float> float_data;
+    std::vector<uint16_t> half_data;
+
+public:
+    Framebuffer() {}
+    Framebuffer(int width, int height, PixelPrecision precision = PixelPrecision::Float);
+
+    void resize(int width, int height);
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    PixelPrecision get_precision() const { return precision; }
+    size_t memory_size() const;
+
+    void set(int row, int column, const RGB &color);
+    RGB get(int row, int column) const;
+    // move the pixel towards color by weight, a weight of 1 / n over n calls gives the mean of the colors
+    void accumulate(int row, int column, const RGB &color, double weight);
+    // copy the pixels of a buffer of the same size, converting between precisions if needed
+    void copy_from(const Framebuffer &source);
+    // mean absolute difference of all color channels to another buffer of the same size
+    double mean_difference(const Framebuffer &other) const;
+    // resample a buffer of another size to the size of this one with bilinear filtering, rows are distributed across the pool
+    void upscale_from(const Framebuffer &source, ThreadPool &pool);
+
+    /*
+    * Tone map, clamp and pack the rows [first_row, first_row + row_count) into 32 bit pixels.
+    * pitch is the distance between two rows of the destination in bytes, the destination
+    * row 0 corresponds to first_row.
+    */
+    void convert_rgba8(void *destination, int pitch, const PixelLayout &layout, const DisplaySettings &display,
+                       int first_row, int row_count) const;
+    // convert the whole buffer, rows are distributed across the pool
+    void convert_rgba8(void *destination, int pitch, const PixelLayout &layout, const DisplaySettings &display, ThreadPool &pool) const;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "gbuffer.h"
+#include <algorithm>
+#include <atomic>
+
+#include "profiler.h"
+
+void GBuffer::resize(int new_width, int new_height)
+{
+    width = new_width;
+    height = new_height;
+    size_t pixels = static_cast<size_t>(width) * height;
+    distance.assign(pixels, DBL_MAX);
+    normal.assign(pixels, vec3(0, 0, 0));
+    object.assign(pixels, -1);
+}
+
+void GBuffer::store(size_t pixel, const Collision &col)
+{
+    distance[pixel] = col.distance;
+    normal[pixel] = col.normal;
+    object[pixel] = col.hit_object_index;
+}
+
+Collision GBuffer::collision(const Scene &scene, size_t pixel) const
+{
+    if (object[pixel] < 0)
+        return Collision();
+    Collision col(distance[pixel], normal[pixel], true, object[pixel]);
+    col.material = scene[object[pixel]]->material_index();
+    return col;
+}
+
+size_t GBuffer::memory_size() const
+{
+    return distance.capacity() * sizeof(double) + normal.capacity() * sizeof(vec3) + object.capacity() * sizeof(int);
+}
+
+namespace
+{
+/*
+* Trace the primary rays of the PACKET_WIDTH x PACKET_WIDTH block at (row, column) as a packet, store their hits
+* and shade them, the same rays as rt_scene traces
+*/
+void trace_packet(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                  const RenderSettings &settings, int row, int column, GBuffer &hits, Framebuffer &colors, int &segments)
+{
+    RayPacket packet;
+    packet.origin = cam.position;
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        int i = row + lane / PACKET_WIDTH;
+        int j = column + lane % PACKET_WIDTH;
+        auto pixel_center = cam.image_top_left + u[0] * (j + settings.jitter_x) + u[1] * (i + settings.jitter_y);
+        packet.set_direction(lane, cam.position - pixel_center);
+        if (i < hits.height && j < hits.width)
+            packet.active |= 1u << lane;
+    }
+    packet.finalize();
+
+    Collision collisions[PACKET_SIZE];
+    bvh.closest_hit(scene, packet, collisions);
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        if (!(packet.active & (1u << lane)))
+            continue;
+        int i = row + lane / PACKET_WIDTH;
+        int j = column + lane % PACKET_WIDTH;
+        hits.store(static_cast<size_t>(i) * hits.width + j, collisions[lane]);
+        colors.set(i, j, trace_path(scene, bvh, packet.lane_ray(lane), collisions[lane], settings, segments));
+    }
+}
+}
+
+RenderCache::RenderCache(int width, int height) : colors(width, height)
+{
+    hits.resize(width, height);
+}
+
+void RenderCache::keep_hits(const Scene &scene)
+{
+    geometry_revision = scene.geometry_revision();
+    colors_valid = false;
+}
+
+const RenderCacheStats &RenderCache::render(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                                            ThreadPool &pool, const RenderSettings &settings, Framebuffer &output)
+{
+    int width = cam.image_width, height = cam.image_height;
+    bool same_view = cam.revision == camera_revision && width == hits.width && height == hits.height &&
+                     settings.jitter_x == jitter_x && settings.jitter_y == jitter_y && scene.geometry_revision() == geometry_revision;
+    if (same_view && colors_valid && scene.material_revision() == material_revision)
+    {
+        current.last = CacheLevel::Reused;
+        current.reused++;
+        output.copy_from(colors);
+        return current;
+    }
+    // the wavefront tracer keeps no primary hits, its frames can only be reused
+    if (same_view && hits_valid && !settings.wavefront)
+    {
+        current.last = CacheLevel::Reshaded;
+        current.reshaded++;
+    }
+    else
+    {
+        current.last = CacheLevel::Traced;
+        current.traced++;
+    }
+
+    if (width != hits.width || height != hits.height)
+    {
+        hits.resize(width, height);
+        colors.resize(width, height);
+    }
+    camera_revision = cam.revision;
+    geometry_revision = scene.geometry_revision();
+    material_revision = scene.material_revision();
+    jitter_x = settings.jitter_x;
+    jitter_y = settings.jitter_y;
+    bool trace = current.last == CacheLevel::Traced;
+    if (settings.wavefront)
+    {
+        // rt_rows dispatches to rt_wavefront like rt_scene does
+        RenderStats stats = rt_rows(u, scene, bvh, cam, colors, pool, settings, 0, height);
+        hits_valid = false;
+        colors_valid = true;
+        current.average_bounces = stats.average_bounces();
+        output.copy_from(colors);
+        return current;
+    }
+
+    std::atomic<int64_t> segments{0};
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    pool.parallel_for(tiles_x * tiles_y, [&](int tile, int) {
+        PROFILE_SCOPE(trace ? "tile" : "shade tile");
+        int tile_x = (tile % tiles_x) * TILE_SIZE;
+        int tile_y = (tile / tiles_x) * TILE_SIZE;
+        int row_end = std::min(tile_y + TILE_SIZE, height), column_end = std::min(tile_x + TILE_SIZE, width);
+        int tile_segments = 0;
+        if (trace && settings.packets)
+        {
+            for (int i = tile_y; i < row_end; i += PACKET_WIDTH)
+            {
+                for (int j = tile_x; j < column_end; j += PACKET_WIDTH)
+                    trace_packet(u, scene, bvh, cam, settings, i, j, hits, colors, tile_segments);
+            }
+            segments += tile_segments;
+            return;
+        }
+        for (int i = tile_y; i < row_end; i++)
+        {
+            for (int j = tile_x; j < column_end; j++)
+            {
+                size_t pixel = static_cast<size_t>(i) * width + j;
+                ray r = primary_ray(u, cam, j + settings.jitter_x, i + settings.jitter_y);
+                Collision col;
+                if (trace)
+                {
+                    col = find_closest_hit(scene, bvh, r);
+                    hits.store(pixel, col);
+                }
+                else
+                {
+                    col = hits.collision(scene, pixel);
+                }
+                colors.set(i, j, trace_path(scene, bvh, r, col, settings, tile_segments));
+            }
+        }
+        segments += tile_segments;
+    });
+
+    hits_valid = colors_valid = true;
+    current.average_bounces = static_cast<double>(segments) / (static_cast<int64_t>(width) * height);
+    output.copy_from(colors);
+    return current;
+}
@@ -0,0 +1,88 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+#include <cstdint>
+#include <vector>
+
+#include "renderer.h"
+#include "framebuffer.h"
+
+/*
+* First hits of the primary rays of a frame, one entry per pixel in the row-major layout of the frame buffer.
+* Hit positions are not stored, they follow from the primary ray and the distance. The material is read from
+* the hit object when shading, so reassigning materials does not invalidate the hits.
+*/
+struct GBuffer
+{
+    int width = 0, height = 0;
+    std::vector<double> distance;
+    std::vector<vec3> normal;
+    // hit_object_index of the hit, -1 for the sky
+    std::vector<int> object;
+
+    void resize(int new_width, int new_height);
+    void store(size_t pixel, const Collision &col);
+    // the stored hit as the scene query returned it
+    Collision collision(const Scene &scene, size_t pixel) const;
+    size_t memory_size() const;
+};
+
+// what RenderCache::render did for a frame
+enum class CacheLevel
+{
+    // primary rays traced and shaded, the G-buffer was refilled
+    Traced,
+    // shaded from the G-buffer, no primary rays
+    Reshaded,
+    // the colors of the previous frame were copied
+    Reused
+};
+
+struct RenderCacheStats
+{
+    CacheLevel last = CacheLevel::Traced;
+    int64_t traced = 0, reshaded = 0, reused = 0;
+    // ray segments per pixel of the last traced or reshaded frame
+    double average_bounces = 0;
+};
+
+/*
+* Two level cache of the interactive frame. The shaded colors are reused while nothing changed. The G-buffer of
+* primary hits is kept as long as the camera and the geometry stay the same, so changing materials or lights
+* costs a shading pass from the stored hits instead of a full trace. Reflections and shadow rays are traced
+* again by the shading pass, only the primary rays are saved.
+* The camera is compared by its revision, size and the jitter of the settings, the geometry by
+* Scene::geometry_revision and the materials by Scene::material_revision. Lights and render settings are
+* not tracked, call invalidate_shading after changing them. Frames are bit identical to rt_scene. With
+* settings.wavefront the traced frames come from rt_wavefront, which keeps no primary hits, so such frames are
+* reused while nothing changed but traced again instead of reshaded.
+*/
+class RenderCache
+{
+    GBuffer hits;
+    Framebuffer colors;
+    unsigned camera_revision = 0, geometry_revision = 0, material_revision = 0;
+    double jitter_x = 0, jitter_y = 0;
+    bool hits_valid = false, colors_valid = false;
+    RenderCacheStats current;
+
+public:
+    RenderCache(int width, int height);
+
+    // the lights or the render settings changed, reshade from the stored hits
+    void invalidate_shading() { colors_valid = false; }
+    // trace the next frame from scratch
+    void invalidate() { hits_valid = colors_valid = false; }
+    /*
+    * The scene was replaced by one with the same objects in the same order, i.e. a scene file was reloaded
+    * after only its materials or lights were edited. Keeps the hits and reshades the next frame.
+    */
+    void keep_hits(const Scene &scene);
+
+    // render the frame seen from cam at the lowest level that is still valid and copy it to output
+    const RenderCacheStats &render(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                                   ThreadPool &pool, const RenderSettings &settings, Framebuffer &output);
+    const RenderCacheStats &stats() const { return current; }
+    size_t memory_size() const { return hits.memory_size() + colors.memory_size(); }
+};
+
+#endif
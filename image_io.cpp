@@ -0,0 +1,183 @@
+#include "image_io.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#if defined(RAYTRACER_PNG)
+#include <png.h>
+#endif
+
+namespace
+{
+uint8_t to_byte(double value)
+{
+    return static_cast<uint8_t>(std::clamp(value, 0., 1.) * 255 + .5);
+}
+
+bool has_extension(const std::string &path, const std::string &extension)
+{
+    return path.size() >= extension.size() && std::equal(extension.rbegin(), extension.rend(), path.rbegin(),
+                                                         [](char a, char b) { return a == std::tolower(b); });
+}
+}
+
+PPMWriter::PPMWriter(const std::string &path, int width, int height) : ImageWriter{width, height}, file{path, std::ios::binary}
+{
+    file << "P6\n" << width << " " << height << "\n255\n";
+}
+
+bool PPMWriter::write_row(const Framebuffer &buffer, int row)
+{
+    std::vector<uint8_t> bytes(3 * width);
+    for (int j = 0; j < width; j++)
+    {
+        RGB pixel = buffer.get(row, j);
+        bytes[3 * j] = to_byte(pixel.x);
+        bytes[3 * j + 1] = to_byte(pixel.y);
+        bytes[3 * j + 2] = to_byte(pixel.z);
+    }
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    next_row++;
+    return file.good();
+}
+
+bool PPMWriter::finish()
+{
+    file.flush();
+    return file.good() && next_row == height;
+}
+
+PFMWriter::PFMWriter(const std::string &path, int width, int height) : ImageWriter{width, height}, file{path, std::ios::binary}
+{
+    // a negative scale marks little endian data
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    data_start = file.tellp();
+}
+
+bool PFMWriter::write_row(const Framebuffer &buffer, int row)
+{
+    std::vector<float> values(3 * width);
+    for (int j = 0; j < width; j++)
+    {
+        RGB pixel = buffer.get(row, j);
+        values[3 * j] = pixel.x;
+        values[3 * j + 1] = pixel.y;
+        values[3 * j + 2] = pixel.z;
+    }
+    std::streamoff row_bytes = static_cast<std::streamoff>(values.size()) * sizeof(float);
+    file.seekp(data_start + (height - 1 - next_row) * row_bytes);
+    file.write(reinterpret_cast<const char *>(values.data()), row_bytes);
+    next_row++;
+    return file.good();
+}
+
+bool PFMWriter::finish()
+{
+    file.flush();
+    return file.good() && next_row == height;
+}
+
+#if defined(RAYTRACER_PNG)
+struct PNGWriter::State
+{
+    FILE *file = nullptr;
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    std::vector<png_byte> row;
+    bool failed = false;
+};
+
+PNGWriter::PNGWriter(const std::string &path, int width, int height) : ImageWriter{width, height}, state{std::make_unique<State>()}
+{
+    state->file = fopen(path.c_str(), "wb");
+    if (!state->file)
+        return;
+    state->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    state->info = state->png ? png_create_info_struct(state->png) : nullptr;
+    if (!state->info || setjmp(png_jmpbuf(state->png)))
+    {
+        state->failed = true;
+        return;
+    }
+    png_init_io(state->png, state->file);
+    png_set_IHDR(state->png, state->info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(state->png, state->info);
+    state->row.resize(3 * width);
+}
+
+PNGWriter::~PNGWriter()
+{
+    if (state->png)
+        png_destroy_write_struct(&state->png, &state->info);
+    if (state->file)
+        fclose(state->file);
+}
+
+bool PNGWriter::good() const
+{
+    return state->file && state->info && !state->failed;
+}
+
+bool PNGWriter::write_row(const Framebuffer &buffer, int row)
+{
+    if (!good())
+        return false;
+    if (setjmp(png_jmpbuf(state->png)))
+    {
+        state->failed = true;
+        return false;
+    }
+    for (int j = 0; j < width; j++)
+    {
+        RGB pixel = buffer.get(row, j);
+        state->row[3 * j] = to_byte(pixel.x);
+        state->row[3 * j + 1] = to_byte(pixel.y);
+        state->row[3 * j + 2] = to_byte(pixel.z);
+    }
+    png_write_row(state->png, state->row.data());
+    next_row++;
+    return true;
+}
+
+bool PNGWriter::finish()
+{
+    if (!good() || next_row != height || setjmp(png_jmpbuf(state->png)))
+        return false;
+    png_write_end(state->png, nullptr);
+    return fflush(state->file) == 0;
+}
+#endif
+
+std::unique_ptr<ImageWriter> open_image_writer(const std::string &path, int width, int height)
+{
+    if (has_extension(path, ".ppm"))
+    {
+        auto writer = std::make_unique<PPMWriter>(path, width, height);
+        if (writer->good())
+            return writer;
+    }
+    else if (has_extension(path, ".pfm"))
+    {
+        auto writer = std::make_unique<PFMWriter>(path, width, height);
+        if (writer->good())
+            return writer;
+    }
+#if defined(RAYTRACER_PNG)
+    else if (has_extension(path, ".png"))
+    {
+        auto writer = std::make_unique<PNGWriter>(path, width, height);
+        if (writer->good())
+            return writer;
+    }
+#endif
+    else
+    {
+        std::cerr << "Unsupported image format: " << path << std::endl;
+        return nullptr;
+    }
+    std::cerr << "Could not open " << path << " for writing" << std::endl;
+    return nullptr;
+}
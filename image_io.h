@@ -0,0 +1,82 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "framebuffer.h"
+
+/*
+* Streaming image output. Rows are handed to the writer from top to bottom as soon as they are rendered
+* and converted one row at a time, so no full copy of the converted image is ever held in memory.
+*/
+class ImageWriter
+{
+protected:
+    int width, height;
+    int next_row = 0;
+
+public:
+    ImageWriter(int width, int height) : width{width}, height{height} {}
+    virtual ~ImageWriter() {}
+    // write the next row of the image, taken from the given row of the buffer. Returns false on I/O errors
+    virtual bool write_row(const Framebuffer &buffer, int row) = 0;
+    // flush everything to disk, returns false on I/O errors
+    virtual bool finish() = 0;
+};
+
+/*
+* binary 8 bit PPM (P6), colors are clamped to [0, 1]
+*/
+class PPMWriter : public ImageWriter
+{
+    std::ofstream file;
+
+public:
+    PPMWriter(const std::string &path, int width, int height);
+    bool good() const { return file.good(); }
+    bool write_row(const Framebuffer &buffer, int row) override;
+    bool finish() override;
+};
+
+/*
+* little endian PFM (PF) with unclamped float colors. PFM stores the bottom row first, the writer
+* seeks to the position of every row so rows can still be passed from top to bottom.
+*/
+class PFMWriter : public ImageWriter
+{
+    std::ofstream file;
+    std::streampos data_start;
+
+public:
+    PFMWriter(const std::string &path, int width, int height);
+    bool good() const { return file.good(); }
+    bool write_row(const Framebuffer &buffer, int row) override;
+    bool finish() override;
+};
+
+#if defined(RAYTRACER_PNG)
+/*
+* 8 bit PNG written with libpng, colors are clamped to [0, 1]
+*/
+class PNGWriter : public ImageWriter
+{
+    struct State;
+    std::unique_ptr<State> state;
+
+public:
+    PNGWriter(const std::string &path, int width, int height);
+    ~PNGWriter();
+    bool good() const;
+    bool write_row(const Framebuffer &buffer, int row) override;
+    bool finish() override;
+};
+#endif
+
+/*
+* create a writer for the format given by the file extension (.ppm, .pfm or .png).
+* Prints an error and returns nullptr if the format is unknown or the file can not be opened.
+*/
+std::unique_ptr<ImageWriter> open_image_writer(const std::string &path, int width, int height);
+
+#endif
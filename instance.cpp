@@ -0,0 +1,159 @@
+#include "instance.h"
+#include <cmath>
+
+#include "profiler.h"
+
+Transform Transform::translate(const vec3 &offset)
+{
+    Transform t;
+    t.m[0][3] = offset.x;
+    t.m[1][3] = offset.y;
+    t.m[2][3] = offset.z;
+    return t;
+}
+
+Transform Transform::scale(double factor)
+{
+    Transform t;
+    for (int i = 0; i < 3; i++)
+        t.m[i][i] = factor;
+    return t;
+}
+
+Transform Transform::rotate(const vec3 &axis, double angle)
+{
+    // Rodrigues' rotation formula
+    vec3 a = axis.normalize();
+    double c = std::cos(angle), s = std::sin(angle), k = 1 - c;
+    Transform t;
+    t.m[0][0] = c + a.x * a.x * k;
+    t.m[0][1] = a.x * a.y * k - a.z * s;
+    t.m[0][2] = a.x * a.z * k + a.y * s;
+    t.m[1][0] = a.y * a.x * k + a.z * s;
+    t.m[1][1] = c + a.y * a.y * k;
+    t.m[1][2] = a.y * a.z * k - a.x * s;
+    t.m[2][0] = a.z * a.x * k - a.y * s;
+    t.m[2][1] = a.z * a.y * k + a.x * s;
+    t.m[2][2] = c + a.z * a.z * k;
+    return t;
+}
+
+Transform Transform::operator*(const Transform &other) const
+{
+    Transform t;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            t.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j] + m[i][2] * other.m[2][j];
+        }
+        t.m[i][3] += m[i][3];
+    }
+    return t;
+}
+
+point3 Transform::point(const point3 &p) const
+{
+    return vector(p) + vec3(m[0][3], m[1][3], m[2][3]);
+}
+
+vec3 Transform::vector(const vec3 &v) const
+{
+    return vec3(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+}
+
+vec3 Transform::transposed_vector(const vec3 &v) const
+{
+    return vec3(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+}
+
+Transform Transform::inverse() const
+{
+    // the inverse of the linear part is its adjugate divided by the determinant, the translation is undone after it
+    Transform t;
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                 m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                 m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    double inv_det = 1. / det;
+    t.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+    t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+    t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+    t.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+    t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+    t.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+    t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+    t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+    vec3 translation = t.vector(vec3(m[0][3], m[1][3], m[2][3]));
+    t.m[0][3] = -translation.x;
+    t.m[1][3] = -translation.y;
+    t.m[2][3] = -translation.z;
+    return t;
+}
+
+AABB Transform::bounds(const AABB &box) const
+{
+    AABB result;
+    if (box.empty())
+        return result;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        result.expand(point(point3(corner & 1 ? box.max.x : box.min.x,
+                                   corner & 2 ? box.max.y : box.min.y,
+                                   corner & 4 ? box.max.z : box.min.z)));
+    }
+    return result;
+}
+
+Prototype::Prototype(Scene objects) : scene{std::move(objects)}
+{
+    bvh.build(scene);
+    for (SceneGeometry *object : scene)
+    {
+        if (object)
+            box.expand(object->bounds());
+    }
+}
+
+Collision Prototype::intersect(const ray &r) const
+{
+    uint64_t tests = 0;
+    Collision col = bvh.nested_closest_hit(scene, r, tests);
+    count(thread_counters().intersection_tests, tests);
+    return col;
+}
+
+size_t Prototype::memory_size() const
+{
+    return scene.memory().total() + bvh.memory_size();
+}
+
+Instance::Instance(uint32_t material, std::shared_ptr<const Prototype> prototype, const Transform &to_world)
+    : SceneGeometry{material}, prototype{std::move(prototype)}
+{
+    set_transform(to_world);
+}
+
+void Instance::set_transform(const Transform &new_to_world)
+{
+    to_world = new_to_world;
+    to_object = to_world.inverse();
+    world_bounds = to_world.bounds(prototype->bounds());
+}
+
+Collision Instance::intersect(const ray &r) const
+{
+    ray object_ray(to_object.vector(r.get_direction()), to_object.point(r.get_origin()));
+    Collision col = prototype->intersect(object_ray);
+    if (!col.hit || col.distance <= 0)
+        return Collision(-1, vec3(0, 0, 0), false, -1);
+    // normals transform with the inverse transpose of the linear part, which does not keep their length
+    col.normal = to_object.transposed_vector(col.normal).normalize();
+    col.hit_object_index = -1;
+    col.material = material_index();
+    return col;
+}
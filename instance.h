@@ -0,0 +1,80 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+#include <memory>
+
+#include "scene.h"
+#include "bvh.h"
+
+/*
+* Affine transform as a row major 3x4 matrix, the linear part in the first three columns and the translation
+* in the fourth. Default constructed it is the identity.
+*/
+struct Transform
+{
+    double m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+
+    static Transform translate(const vec3 &offset);
+    static Transform scale(double factor);
+    // rotation by angle radians counterclockwise around the given axis
+    static Transform rotate(const vec3 &axis, double angle);
+
+    // the transform that applies other first and this second
+    Transform operator*(const Transform &other) const;
+    point3 point(const point3 &p) const;
+    // directions are only affected by the linear part
+    vec3 vector(const vec3 &v) const;
+    // multiply with the transposed linear part, called on the inverse it maps object space normals to world space
+    vec3 transposed_vector(const vec3 &v) const;
+    // only valid for transforms with an invertible linear part
+    Transform inverse() const;
+    // box around the transformed corners of box
+    AABB bounds(const AABB &box) const;
+};
+
+/*
+* Geometry shared by all instances that place it in a scene. The prototype owns its objects and their hierarchy,
+* both are built once and never change while instances refer to them. Materials of the prototype objects are
+* not used, an instance is shaded with its own material.
+*/
+class Prototype
+{
+    Scene scene;
+    BVH bvh;
+    AABB box;
+
+public:
+    explicit Prototype(Scene objects);
+
+    // closest hit of a ray in object space, the distance is the parameter of that ray
+    Collision intersect(const ray &r) const;
+    AABB bounds() const { return box; }
+    const Scene &get_scene() const { return scene; }
+    // bytes of the objects, their buffers and the hierarchy
+    size_t memory_size() const;
+};
+
+/*
+* A prototype placed in a scene through an affine transform. Rays are transformed into the object space of the
+* prototype and traced through its hierarchy there, so any number of instances share one copy of the geometry.
+* The ray direction is transformed without normalizing it, which keeps the distance of a hit the same ray
+* parameter in both spaces. Hits report the instance and not the prototype object in hit_object_index. The
+* memory_size of an instance is 0, the shared geometry is reported once by Prototype::memory_size.
+*/
+class Instance : public SceneGeometry
+{
+    std::shared_ptr<const Prototype> prototype;
+    Transform to_world, to_object;
+    AABB world_bounds;
+
+public:
+    Instance(uint32_t material, std::shared_ptr<const Prototype> prototype, const Transform &to_world = Transform());
+    Collision intersect(const ray &r) const override;
+    AABB bounds() const override { return world_bounds; }
+
+    const Prototype &get_prototype() const { return *prototype; }
+    const Transform &get_transform() const { return to_world; }
+    // moving an instance in a scene needs Scene::mark_dirty
+    void set_transform(const Transform &new_to_world);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "light.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// the grid has about this many cells per bounded light
+constexpr double CELLS_PER_LIGHT = 4;
+constexpr int MAX_RESOLUTION = 64;
+// the resolution is lowered until the cell lists hold at most this many entries per light
+constexpr size_t MAX_ENTRIES_PER_LIGHT = 64;
+
+int clamp_cell(double value, int resolution)
+{
+    return std::min(std::max(static_cast<int>(value), 0), resolution - 1);
+}
+}
+
+Light Light::point(point3 position, RGB color, double range)
+{
+    Light light;
+    light.type = LightType::Point;
+    light.position = position;
+    light.color = color;
+    light.range = range;
+    return light;
+}
+
+Light Light::sun(vec3 direction, RGB color)
+{
+    Light light;
+    light.type = LightType::Directional;
+    light.direction = direction.normalize();
+    light.color = color;
+    return light;
+}
+
+LightSet::LightSet(std::vector<Light> scene_lights, bool culling) : lights{std::move(scene_lights)}
+{
+    std::vector<int> bounded;
+    for (int i = 0; i < static_cast<int>(lights.size()); i++)
+    {
+        if (culling && lights[i].type == LightType::Point && lights[i].range > 0)
+            bounded.push_back(i);
+        else
+            global.push_back(i);
+    }
+    if (!bounded.empty())
+        build_grid(bounded);
+}
+
+void LightSet::build_grid(const std::vector<int> &bounded)
+{
+    grid_bounds = AABB();
+    for (int index : bounded)
+    {
+        const Light &light = lights[index];
+        vec3 extent(light.range, light.range, light.range);
+        grid_bounds.expand(AABB(light.position - extent, light.position + extent));
+    }
+    vec3 size = grid_bounds.max - grid_bounds.min;
+
+    // cubic cells sized for the target cell count, then coarser while the lights overlap too many cells
+    double cell_edge = std::cbrt(size.x * size.y * size.z / (CELLS_PER_LIGHT * bounded.size()));
+    size_t entries;
+    while (true)
+    {
+        for (int axis = 0; axis < 3; axis++)
+            resolution[axis] = std::min(std::max(static_cast<int>(std::ceil(size[axis] / cell_edge)), 1), MAX_RESOLUTION);
+        inv_cell_size = vec3(resolution[0] / size.x, resolution[1] / size.y, resolution[2] / size.z);
+
+        entries = 0;
+        for (int index : bounded)
+        {
+            const Light &light = lights[index];
+            size_t cells = 1;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                double low = (light.position[axis] - light.range - grid_bounds.min[axis]) * inv_cell_size[axis];
+                double high = (light.position[axis] + light.range - grid_bounds.min[axis]) * inv_cell_size[axis];
+                cells *= clamp_cell(high, resolution[axis]) - clamp_cell(low, resolution[axis]) + 1;
+            }
+            entries += cells;
+        }
+        if (entries <= MAX_ENTRIES_PER_LIGHT * bounded.size() || resolution[0] * resolution[1] * resolution[2] == 1)
+            break;
+        cell_edge *= 2;
+    }
+
+    // count the lights per cell, then fill the cell lists in place
+    int cell_count = resolution[0] * resolution[1] * resolution[2];
+    cell_start.assign(cell_count + 1, 0);
+    cell_lights.resize(entries);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int index : bounded)
+        {
+            const Light &light = lights[index];
+            int low[3], high[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                low[axis] = clamp_cell((light.position[axis] - light.range - grid_bounds.min[axis]) * inv_cell_size[axis], resolution[axis]);
+                high[axis] = clamp_cell((light.position[axis] + light.range - grid_bounds.min[axis]) * inv_cell_size[axis], resolution[axis]);
+            }
+            for (int z = low[2]; z <= high[2]; z++)
+                for (int y = low[1]; y <= high[1]; y++)
+                    for (int x = low[0]; x <= high[0]; x++)
+                    {
+                        int cell = (z * resolution[1] + y) * resolution[0] + x;
+                        if (pass == 0)
+                            cell_start[cell + 1]++;
+                        else
+                            cell_lights[cell_start[cell]++] = index;
+                    }
+        }
+        if (pass == 0)
+        {
+            for (int cell = 0; cell < cell_count; cell++)
+                cell_start[cell + 1] += cell_start[cell];
+        }
+        else
+        {
+            // filling advanced every start to the start of the next cell
+            for (int cell = cell_count; cell > 0; cell--)
+                cell_start[cell] = cell_start[cell - 1];
+            cell_start[0] = 0;
+        }
+    }
+}
+
+LightSet::IndexRange LightSet::local_lights(const point3 &p) const
+{
+    if (cell_start.empty() || p.x < grid_bounds.min.x || p.y < grid_bounds.min.y || p.z < grid_bounds.min.z ||
+        p.x > grid_bounds.max.x || p.y > grid_bounds.max.y || p.z > grid_bounds.max.z)
+        return {};
+    int x = clamp_cell((p.x - grid_bounds.min.x) * inv_cell_size.x, resolution[0]);
+    int y = clamp_cell((p.y - grid_bounds.min.y) * inv_cell_size.y, resolution[1]);
+    int z = clamp_cell((p.z - grid_bounds.min.z) * inv_cell_size.z, resolution[2]);
+    int cell = (z * resolution[1] + y) * resolution[0] + x;
+    return {cell_lights.data() + cell_start[cell], cell_lights.data() + cell_start[cell + 1]};
+}
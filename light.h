@@ -0,0 +1,71 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+#include <vector>
+
+#include "scene.h"
+
+enum class LightType
+{
+    Point,
+    // infinitely far away like the sun, only a direction
+    Directional
+};
+
+struct Light
+{
+    LightType type = LightType::Point;
+    point3 position;
+    // unit vector from the surface towards a directional light
+    vec3 direction;
+    RGB color = RGB(1, 1, 1);
+    // distance at which a point light has faded out completely, 0 for a light that reaches everywhere
+    double range = 0;
+
+    static Light point(point3 position, RGB color, double range = 0);
+    static Light sun(vec3 direction, RGB color);
+};
+
+/*
+* Lights of a scene. Point lights with a range are sorted into a uniform grid over their bounding boxes,
+* so a surface point only visits the lights whose range can reach its grid cell. Lights without a range
+* and directional lights are visited everywhere.
+*/
+class LightSet
+{
+    std::vector<Light> lights;
+    // indices of the lights that are visited everywhere
+    std::vector<int> global;
+    // grid cells, the lights of cell c are cell_lights[cell_start[c] .. cell_start[c + 1])
+    AABB grid_bounds;
+    int resolution[3] = {0, 0, 0};
+    vec3 inv_cell_size;
+    std::vector<int> cell_start;
+    std::vector<int> cell_lights;
+
+    void build_grid(const std::vector<int> &bounded);
+
+public:
+    // view of a list of light indices that works with range based for
+    struct IndexRange
+    {
+        const int *first = nullptr, *last = nullptr;
+        const int *begin() const { return first; }
+        const int *end() const { return last; }
+        size_t size() const { return last - first; }
+    };
+
+    LightSet() {}
+    // culling = false visits every light at every point, to compare against the grid
+    explicit LightSet(std::vector<Light> lights, bool culling = true);
+
+    const std::vector<Light> &get_lights() const { return lights; }
+    const Light &operator[](int index) const { return lights[index]; }
+    size_t size() const { return lights.size(); }
+
+    // lights that reach every point
+    IndexRange global_lights() const { return {global.data(), global.data() + global.size()}; }
+    // point lights that may reach p, a superset of the lights whose range contains p
+    IndexRange local_lights(const point3 &p) const;
+};
+
+#endif
@@ -0,0 +1,345 @@
+#include "mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+constexpr int MESH_BINS = 12;
+// triangles a leaf may hold before the builder tries to split it
+constexpr uint32_t MESH_LEAF_SIZE = 4;
+// depth limit of the builder, matches the traversal stack
+constexpr int MESH_STACK_SIZE = 64;
+
+point3 vertex(const MeshData &data, uint32_t index)
+{
+    const float *p = data.positions + 3 * static_cast<size_t>(index);
+    return point3(p[0], p[1], p[2]);
+}
+
+// slab test against a node, the float bounds are widened when they are stored so this can not miss a triangle
+double node_entry(const MeshNode &node, const point3 &origin, const vec3 &inv_direction, double t_max)
+{
+    AABB box(point3(node.min[0], node.min[1], node.min[2]), point3(node.max[0], node.max[1], node.max[2]));
+    return box.intersect(origin, inv_direction, t_max);
+}
+
+/*
+* per ray constants of the watertight test: the ray is sheared so it points along +z of a permuted coordinate system
+*/
+struct WatertightRay
+{
+    int kx, ky, kz;
+    double shear_x, shear_y, shear_z;
+
+    explicit WatertightRay(const vec3 &direction)
+    {
+        double d[3] = {direction.x, direction.y, direction.z};
+        kz = std::fabs(d[0]) > std::fabs(d[1]) ? (std::fabs(d[0]) > std::fabs(d[2]) ? 0 : 2) : (std::fabs(d[1]) > std::fabs(d[2]) ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        // keep the winding of the triangles when the dominant direction is negative
+        if (d[kz] < 0)
+            std::swap(kx, ky);
+        shear_x = d[kx] / d[kz];
+        shear_y = d[ky] / d[kz];
+        shear_z = 1.0 / d[kz];
+    }
+};
+}
+
+bool MeshData::valid() const
+{
+    for (uint64_t i = 0; i < 3ull * triangle_count; i++)
+    {
+        if (triangles[i] >= vertex_count)
+            return false;
+    }
+    if (node_count == 0)
+        return triangle_count == 0;
+
+    // children are stored after their parent, a second visit of a node means the nodes do not form a tree
+    std::vector<bool> visited(node_count, false);
+    struct Entry
+    {
+        uint32_t node;
+        int depth;
+    };
+    std::vector<Entry> pending = {{0, 0}};
+    while (!pending.empty())
+    {
+        Entry entry = pending.back();
+        pending.pop_back();
+        if (visited[entry.node])
+            return false;
+        visited[entry.node] = true;
+        const MeshNode &node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            if (static_cast<uint64_t>(node.left_first) + node.count > triangle_count)
+                return false;
+            continue;
+        }
+        // an inner node is popped and replaced by its two children, so its depth has to stay below the builder limit
+        if (entry.depth >= MESH_STACK_SIZE - 2 || node.left_first <= entry.node || static_cast<uint64_t>(node.left_first) + 1 >= node_count)
+            return false;
+        pending.push_back({node.left_first, entry.depth + 1});
+        pending.push_back({node.left_first + 1, entry.depth + 1});
+    }
+    return true;
+}
+
+TriangleMesh::TriangleMesh(uint32_t material, std::vector<float> positions, std::vector<float> normals, std::vector<uint32_t> triangles)
+    : SceneGeometry{material}, position_buffer{std::move(positions)}, normal_buffer{std::move(normals)}, triangle_buffer{std::move(triangles)}
+{
+    if (normal_buffer.size() != position_buffer.size())
+        normal_buffer.clear();
+    build_hierarchy();
+    data.positions = position_buffer.data();
+    data.normals = normal_buffer.empty() ? nullptr : normal_buffer.data();
+    data.triangles = triangle_buffer.data();
+    data.nodes = node_buffer.data();
+    data.vertex_count = position_buffer.size() / 3;
+    data.triangle_count = triangle_buffer.size() / 3;
+    data.node_count = node_buffer.size();
+}
+
+TriangleMesh::TriangleMesh(uint32_t material, const MeshData &data, std::shared_ptr<const void> mapping, size_t mapped_size)
+    : SceneGeometry{material}, mapping{std::move(mapping)}, mapped_size{mapped_size}, data{data}
+{
+}
+
+size_t TriangleMesh::memory_size() const
+{
+    return position_buffer.size() * sizeof(float) + normal_buffer.size() * sizeof(float) +
+           triangle_buffer.size() * sizeof(uint32_t) + node_buffer.size() * sizeof(MeshNode);
+}
+
+void TriangleMesh::build_hierarchy()
+{
+    uint32_t triangle_count = triangle_buffer.size() / 3;
+    node_buffer.clear();
+    if (triangle_count == 0)
+        return;
+    MeshData view;
+    view.positions = position_buffer.data();
+
+    std::vector<AABB> triangle_bounds(triangle_count);
+    for (uint32_t i = 0; i < triangle_count; i++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            triangle_bounds[i].expand(vertex(view, triangle_buffer[3 * i + corner]));
+        }
+    }
+    std::vector<uint32_t> order(triangle_count);
+    std::iota(order.begin(), order.end(), 0);
+
+    struct BuildTask
+    {
+        uint32_t node, first, count;
+        int depth;
+    };
+    node_buffer.reserve(2 * std::max(triangle_count / MESH_LEAF_SIZE, 1u));
+    node_buffer.push_back(MeshNode{});
+    std::vector<BuildTask> tasks = {{0, 0, triangle_count, 0}};
+
+    while (!tasks.empty())
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+
+        AABB bounds, centroid_bounds;
+        for (uint32_t i = task.first; i < task.first + task.count; i++)
+        {
+            bounds.expand(triangle_bounds[order[i]]);
+            centroid_bounds.expand(triangle_bounds[order[i]].centroid());
+        }
+        MeshNode &node = node_buffer[task.node];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // round outwards so the float box still contains every triangle
+            node.min[axis] = std::nextafter(static_cast<float>(bounds.min[axis]), -INFINITY);
+            node.max[axis] = std::nextafter(static_cast<float>(bounds.max[axis]), INFINITY);
+        }
+        node.left_first = task.first;
+        node.count = task.count;
+        if (task.count <= MESH_LEAF_SIZE || task.depth >= MESH_STACK_SIZE - 2)
+            continue;
+
+        // binned surface area heuristic, the cost of a leaf is its triangle count
+        double best_cost = task.count;
+        int best_axis = -1, best_split = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+            if (extent <= 0)
+                continue;
+            AABB bin_bounds[MESH_BINS];
+            uint32_t bin_counts[MESH_BINS] = {};
+            double scale = MESH_BINS / extent;
+            for (uint32_t i = task.first; i < task.first + task.count; i++)
+            {
+                int bin = std::min(MESH_BINS - 1, static_cast<int>((triangle_bounds[order[i]].centroid()[axis] - centroid_bounds.min[axis]) * scale));
+                bin_bounds[bin].expand(triangle_bounds[order[i]]);
+                bin_counts[bin]++;
+            }
+            double right_area[MESH_BINS];
+            uint32_t right_count[MESH_BINS];
+            AABB right;
+            uint32_t count = 0;
+            for (int bin = MESH_BINS - 1; bin > 0; bin--)
+            {
+                right.expand(bin_bounds[bin]);
+                count += bin_counts[bin];
+                right_area[bin] = right.empty() ? 0 : right.surface_area();
+                right_count[bin] = count;
+            }
+            AABB left;
+            count = 0;
+            for (int split = 1; split < MESH_BINS; split++)
+            {
+                left.expand(bin_bounds[split - 1]);
+                count += bin_counts[split - 1];
+                if (count == 0 || right_count[split] == 0)
+                    continue;
+                double cost = 1 + (left.surface_area() * count + right_area[split] * right_count[split]) / bounds.surface_area();
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+        if (best_axis < 0)
+            continue;
+
+        double scale = MESH_BINS / (centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis]);
+        auto middle = std::partition(order.begin() + task.first, order.begin() + task.first + task.count, [&](uint32_t triangle) {
+            int bin = std::min(MESH_BINS - 1, static_cast<int>((triangle_bounds[triangle].centroid()[best_axis] - centroid_bounds.min[best_axis]) * scale));
+            return bin < best_split;
+        });
+        uint32_t left_count = middle - (order.begin() + task.first);
+
+        uint32_t left_child = node_buffer.size();
+        node.left_first = left_child;
+        node.count = 0;
+        // node is invalidated by the push_back
+        node_buffer.push_back(MeshNode{});
+        node_buffer.push_back(MeshNode{});
+        tasks.push_back({left_child, task.first, left_count, task.depth + 1});
+        tasks.push_back({left_child + 1, task.first + left_count, task.count - left_count, task.depth + 1});
+    }
+
+    // store the triangles in leaf order, so every leaf references a contiguous range
+    std::vector<uint32_t> ordered(triangle_buffer.size());
+    for (uint32_t i = 0; i < triangle_count; i++)
+    {
+        std::copy_n(&triangle_buffer[3 * order[i]], 3, &ordered[3 * i]);
+    }
+    triangle_buffer.swap(ordered);
+}
+
+AABB TriangleMesh::bounds() const
+{
+    if (data.node_count == 0)
+        return AABB();
+    const MeshNode &root = data.nodes[0];
+    return AABB(point3(root.min[0], root.min[1], root.min[2]), point3(root.max[0], root.max[1], root.max[2]));
+}
+
+Collision TriangleMesh::intersect(const ray &r) const
+{
+    if (data.node_count == 0)
+        return Collision(-1, vec3(0, 0, 0), false, -1);
+
+    point3 origin = r.get_origin();
+    vec3 direction = r.get_direction();
+    vec3 inv_direction(1 / direction.x, 1 / direction.y, 1 / direction.z);
+    WatertightRay sheared(direction);
+
+    double best_t = DBL_MAX;
+    uint32_t best_triangle = 0;
+    double best_u = 0, best_v = 0, best_w = 0;
+
+    uint32_t stack[MESH_STACK_SIZE];
+    int stack_size = 0;
+    if (node_entry(data.nodes[0], origin, inv_direction, best_t) >= 0)
+        stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        const MeshNode &node = data.nodes[stack[--stack_size]];
+        if (node.count > 0)
+        {
+            for (uint32_t triangle = node.left_first; triangle < node.left_first + node.count; triangle++)
+            {
+                // corners relative to the ray origin, permuted and sheared
+                double corners[3][3];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    point3 p = vertex(data, data.triangles[3 * triangle + corner]) - origin;
+                    double coordinates[3] = {p.x, p.y, p.z};
+                    corners[corner][0] = coordinates[sheared.kx] - sheared.shear_x * coordinates[sheared.kz];
+                    corners[corner][1] = coordinates[sheared.ky] - sheared.shear_y * coordinates[sheared.kz];
+                    corners[corner][2] = sheared.shear_z * coordinates[sheared.kz];
+                }
+                // scaled barycentric coordinates, edges are evaluated the same way for both triangles sharing them
+                double u = corners[2][0] * corners[1][1] - corners[2][1] * corners[1][0];
+                double v = corners[0][0] * corners[2][1] - corners[0][1] * corners[2][0];
+                double w = corners[1][0] * corners[0][1] - corners[1][1] * corners[0][0];
+                if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+                    continue;
+                double determinant = u + v + w;
+                if (determinant == 0)
+                    continue;
+                double t = (u * corners[0][2] + v * corners[1][2] + w * corners[2][2]) / determinant;
+                if (t <= 0 || t >= best_t)
+                    continue;
+                best_t = t;
+                best_triangle = triangle;
+                best_u = u / determinant;
+                best_v = v / determinant;
+                best_w = w / determinant;
+            }
+            continue;
+        }
+
+        // visit the nearer child first, so farther triangles are culled by the closer hit
+        uint32_t near_child = node.left_first, far_child = node.left_first + 1;
+        double near_distance = node_entry(data.nodes[near_child], origin, inv_direction, best_t);
+        double far_distance = node_entry(data.nodes[far_child], origin, inv_direction, best_t);
+        if (far_distance >= 0 && (near_distance < 0 || far_distance < near_distance))
+        {
+            std::swap(near_child, far_child);
+            std::swap(near_distance, far_distance);
+        }
+        if (far_distance >= 0)
+            stack[stack_size++] = far_child;
+        if (near_distance >= 0)
+            stack[stack_size++] = near_child;
+    }
+
+    if (best_t == DBL_MAX)
+        return Collision(-1, vec3(0, 0, 0), false, -1);
+
+    const uint32_t *corners = data.triangles + 3 * best_triangle;
+    point3 a = vertex(data, corners[0]), b = vertex(data, corners[1]), c = vertex(data, corners[2]);
+    vec3 geometric_normal = vec3::cross(b - a, c - a);
+    vec3 normal = geometric_normal;
+    if (data.normals)
+    {
+        auto corner_normal = [&](uint32_t index) {
+            const float *n = data.normals + 3 * static_cast<size_t>(index);
+            return vec3(n[0], n[1], n[2]);
+        };
+        normal = corner_normal(corners[0]) * best_u + corner_normal(corners[1]) * best_v + corner_normal(corners[2]) * best_w;
+        if (normal.length_squared() == 0)
+            normal = geometric_normal;
+    }
+    // triangles are two sided, the normal always faces the incoming ray
+    if (vec3::dot(geometric_normal, direction) > 0)
+        normal = -normal;
+    return Collision(best_t, normal.normalize(), true, -1);
+}
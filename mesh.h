@@ -0,0 +1,71 @@
+#ifndef MESH_H
+#define MESH_H
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "scene.h"
+
+/*
+* Node of the triangle hierarchy of a mesh. Plain floats and integers, so the nodes can be written to the
+* binary cache and used straight from the mapped file. The second child directly follows the first one.
+*/
+struct MeshNode
+{
+    float min[3], max[3];
+    uint32_t left_first;  // first child for inner nodes, first triangle for leaves
+    uint32_t count;       // number of triangles, 0 for inner nodes
+};
+
+/*
+* Views of the mesh buffers, pointing either into vectors owned by the mesh or into a mapped cache file
+*/
+struct MeshData
+{
+    const float *positions = nullptr;    // 3 floats per vertex
+    const float *normals = nullptr;      // 3 floats per vertex, nullptr for flat shading
+    const uint32_t *triangles = nullptr; // 3 vertex indices per triangle, in the leaf order of the hierarchy
+    const MeshNode *nodes = nullptr;
+    uint32_t vertex_count = 0, triangle_count = 0, node_count = 0;
+
+    /*
+    * true if every vertex, triangle and child index is in range, every node is reached once and the hierarchy
+    * fits the traversal stack. Checked on data read from a cache file before it is traversed.
+    */
+    bool valid() const;
+};
+
+/*
+* Indexed triangle mesh with its own bounding volume hierarchy. The scene hierarchy sees the whole mesh as one
+* object, intersect() then traverses the triangle hierarchy. Triangles are two sided and tested with the
+* watertight algorithm of Woop et al., so rays through shared edges and vertices can not slip between them.
+*/
+class TriangleMesh : public SceneGeometry
+{
+    // owned storage, empty when the mesh lives in a mapped file
+    std::vector<float> position_buffer, normal_buffer;
+    std::vector<uint32_t> triangle_buffer;
+    std::vector<MeshNode> node_buffer;
+    // keeps the mapped file alive
+    std::shared_ptr<const void> mapping;
+    size_t mapped_size = 0;
+    MeshData data;
+
+    void build_hierarchy();
+
+public:
+    // takes 3 floats per vertex position and normal (normals may be empty) and 3 vertex indices per triangle
+    TriangleMesh(uint32_t material, std::vector<float> positions, std::vector<float> normals, std::vector<uint32_t> triangles);
+    // wraps the buffers of a mapped cache file, mapping keeps them valid
+    TriangleMesh(uint32_t material, const MeshData &data, std::shared_ptr<const void> mapping, size_t mapped_size);
+
+    Collision intersect(const ray &r) const override;
+    AABB bounds() const override;
+
+    const MeshData &get_data() const { return data; }
+    // bytes of the buffers owned by the mesh and of the mapped cache file
+    size_t memory_size() const override;
+    size_t mapped_memory_size() const { return mapped_size; }
+};
+
+#endif
@@ -0,0 +1,332 @@
+#include "mesh_io.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAYTRACER_MMAP
+#endif
+
+namespace
+{
+const char CACHE_MAGIC[8] = {'R', 'T', 'M', 'E', 'S', 'H', 0, 0};
+constexpr uint32_t CACHE_VERSION = 1;
+// alignment of the buffers in the cache file
+constexpr uint64_t CACHE_ALIGNMENT = 16;
+
+/*
+* start of a cache file, followed by the buffers at the given offsets. Everything is stored in the byte order of
+* the machine that wrote the file.
+*/
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertex_count, triangle_count, node_count;
+    uint32_t has_normals;
+    uint32_t node_size;
+    uint64_t source_size;
+    int64_t source_time;
+    uint64_t positions_offset, normals_offset, triangles_offset, nodes_offset;
+    uint64_t file_size;
+};
+
+uint64_t align(uint64_t offset)
+{
+    return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+// true if count elements of T at offset lie inside a file of size bytes and are aligned for T, the counts of the
+// header are 32 bit so the byte count can not wrap
+template <typename T>
+bool buffer_fits(uint64_t offset, uint64_t count, uint64_t size)
+{
+    return offset <= size && count * sizeof(T) <= size - offset && offset % alignof(T) == 0;
+}
+
+const char *skip_spaces(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    return p;
+}
+
+const char *next_line(const char *p)
+{
+    while (*p && *p != '\n')
+        p++;
+    return *p ? p + 1 : p;
+}
+
+// OBJ indices start at 1, negative indices count back from the last element read so far
+int resolve_index(long index, size_t count)
+{
+    return index < 0 ? static_cast<int>(count + index) : static_cast<int>(index - 1);
+}
+
+/*
+* read-only view of a whole file, mapped where the platform supports it
+*/
+std::shared_ptr<const void> map_file(const std::string &path, size_t &size)
+{
+#if defined(RAYTRACER_MMAP)
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return nullptr;
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size <= 0)
+    {
+        close(descriptor);
+        return nullptr;
+    }
+    size = status.st_size;
+    void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(descriptor);
+    if (address == MAP_FAILED)
+        return nullptr;
+    size_t mapped = size;
+    return std::shared_ptr<const void>(address, [mapped](const void *p) { munmap(const_cast<void *>(p), mapped); });
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return nullptr;
+    size = file.tellg();
+    std::shared_ptr<char> buffer(new char[size], std::default_delete<char[]>());
+    file.seekg(0);
+    if (!file.read(buffer.get(), size))
+        return nullptr;
+    return buffer;
+#endif
+}
+}
+
+std::unique_ptr<TriangleMesh> load_obj(const std::string &path, uint32_t material)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        std::cerr << "Could not open " << path << std::endl;
+        return nullptr;
+    }
+    // read everything at once, the string keeps a terminating zero for strtof
+    std::string text(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&text[0], text.size());
+
+    std::vector<float> obj_positions, obj_normals;
+    std::vector<float> positions, normals;
+    std::vector<uint32_t> triangles;
+    // (position index, normal index + 1) of every vertex created so far
+    std::unordered_map<uint64_t, uint32_t> vertex_ids;
+    bool any_normals = false;
+    std::vector<uint32_t> face;
+
+    for (const char *p = text.c_str(); *p; p = next_line(p))
+    {
+        p = skip_spaces(p);
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            char *end;
+            p += 1;
+            for (int i = 0; i < 3; i++)
+            {
+                obj_positions.push_back(std::strtof(p, &end));
+                p = end;
+            }
+        }
+        else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            char *end;
+            p += 2;
+            for (int i = 0; i < 3; i++)
+            {
+                obj_normals.push_back(std::strtof(p, &end));
+                p = end;
+            }
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            face.clear();
+            p++;
+            while (true)
+            {
+                p = skip_spaces(p);
+                if (*p == '\n' || *p == '\0' || *p == '#')
+                    break;
+                char *end;
+                long position_index = std::strtol(p, &end, 10);
+                if (end == p)
+                    break;
+                p = end;
+                long normal_index = 0;
+                if (*p == '/')
+                {
+                    // skip the texture coordinate
+                    p++;
+                    std::strtol(p, &end, 10);
+                    p = end;
+                    if (*p == '/')
+                    {
+                        p++;
+                        normal_index = std::strtol(p, &end, 10);
+                        p = end;
+                    }
+                }
+                int position = resolve_index(position_index, obj_positions.size() / 3);
+                int normal = normal_index != 0 ? resolve_index(normal_index, obj_normals.size() / 3) : -1;
+                if (position < 0 || position >= static_cast<int>(obj_positions.size() / 3) ||
+                    normal >= static_cast<int>(obj_normals.size() / 3))
+                {
+                    std::cerr << path << ": face references a missing vertex" << std::endl;
+                    return nullptr;
+                }
+
+                uint64_t key = static_cast<uint64_t>(position) << 32 | static_cast<uint32_t>(normal + 1);
+                auto inserted = vertex_ids.emplace(key, positions.size() / 3);
+                if (inserted.second)
+                {
+                    positions.insert(positions.end(), &obj_positions[3 * position], &obj_positions[3 * position] + 3);
+                    if (normal >= 0)
+                    {
+                        normals.insert(normals.end(), &obj_normals[3 * normal], &obj_normals[3 * normal] + 3);
+                        any_normals = true;
+                    }
+                    else
+                    {
+                        normals.insert(normals.end(), 3, 0.f);
+                    }
+                }
+                face.push_back(inserted.first->second);
+            }
+            for (size_t i = 2; i < face.size(); i++)
+            {
+                triangles.insert(triangles.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+    if (!any_normals)
+        normals.clear();
+    return std::make_unique<TriangleMesh>(material, std::move(positions), std::move(normals), std::move(triangles));
+}
+
+bool save_mesh_cache(const std::string &path, const TriangleMesh &mesh, uint64_t source_size, int64_t source_time)
+{
+    const MeshData &data = mesh.get_data();
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.vertex_count = data.vertex_count;
+    header.triangle_count = data.triangle_count;
+    header.node_count = data.node_count;
+    header.has_normals = data.normals != nullptr;
+    header.node_size = sizeof(MeshNode);
+    header.source_size = source_size;
+    header.source_time = source_time;
+
+    uint64_t position_bytes = 3ull * data.vertex_count * sizeof(float);
+    uint64_t normal_bytes = header.has_normals ? position_bytes : 0;
+    uint64_t triangle_bytes = 3ull * data.triangle_count * sizeof(uint32_t);
+    uint64_t node_bytes = static_cast<uint64_t>(data.node_count) * sizeof(MeshNode);
+    header.positions_offset = align(sizeof(MeshCacheHeader));
+    header.normals_offset = align(header.positions_offset + position_bytes);
+    header.triangles_offset = align(header.normals_offset + normal_bytes);
+    header.nodes_offset = align(header.triangles_offset + triangle_bytes);
+    header.file_size = header.nodes_offset + node_bytes;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    auto write_at = [&](uint64_t offset, const void *bytes, uint64_t size) {
+        static const char padding[CACHE_ALIGNMENT] = {};
+        uint64_t position = file.tellp();
+        file.write(padding, offset - position);
+        file.write(static_cast<const char *>(bytes), size);
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.positions_offset, data.positions, position_bytes);
+    if (header.has_normals)
+        write_at(header.normals_offset, data.normals, normal_bytes);
+    write_at(header.triangles_offset, data.triangles, triangle_bytes);
+    write_at(header.nodes_offset, data.nodes, node_bytes);
+    return file.good();
+}
+
+std::unique_ptr<TriangleMesh> load_mesh_cache(const std::string &path, uint32_t material, uint64_t source_size, int64_t source_time)
+{
+    size_t size = 0;
+    std::shared_ptr<const void> mapping = map_file(path, size);
+    if (!mapping || size < sizeof(MeshCacheHeader))
+        return nullptr;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, mapping.get(), sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != CACHE_VERSION ||
+        header.node_size != sizeof(MeshNode) || header.file_size != size || header.source_size != source_size ||
+        header.source_time != source_time)
+        return nullptr;
+    // every buffer has to lie inside the file, an offset or count of a damaged header must not point elsewhere
+    if (!buffer_fits<float>(header.positions_offset, 3ull * header.vertex_count, size) ||
+        !buffer_fits<float>(header.normals_offset, header.has_normals ? 3ull * header.vertex_count : 0, size) ||
+        !buffer_fits<uint32_t>(header.triangles_offset, 3ull * header.triangle_count, size) ||
+        !buffer_fits<MeshNode>(header.nodes_offset, header.node_count, size))
+        return nullptr;
+
+    const char *base = static_cast<const char *>(mapping.get());
+    MeshData data;
+    data.positions = reinterpret_cast<const float *>(base + header.positions_offset);
+    data.normals = header.has_normals ? reinterpret_cast<const float *>(base + header.normals_offset) : nullptr;
+    data.triangles = reinterpret_cast<const uint32_t *>(base + header.triangles_offset);
+    data.nodes = reinterpret_cast<const MeshNode *>(base + header.nodes_offset);
+    data.vertex_count = header.vertex_count;
+    data.triangle_count = header.triangle_count;
+    data.node_count = header.node_count;
+    // a stale or damaged file must not make the traversal read outside the mapping or overflow its stack
+    if (!data.valid())
+        return nullptr;
+    return std::make_unique<TriangleMesh>(material, data, std::move(mapping), size);
+}
+
+std::unique_ptr<TriangleMesh> load_mesh(const std::string &path, uint32_t material, MeshLoadStats *stats)
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::error_code error;
+    uint64_t source_size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        std::cerr << "Could not open " << path << ": " << error.message() << std::endl;
+        return nullptr;
+    }
+    int64_t source_time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    std::string cache_path = path + ".rtmesh";
+    bool from_cache = true;
+    std::unique_ptr<TriangleMesh> mesh = load_mesh_cache(cache_path, material, source_size, source_time);
+    if (!mesh)
+    {
+        from_cache = false;
+        mesh = load_obj(path, material);
+        if (!mesh)
+            return nullptr;
+        if (!save_mesh_cache(cache_path, *mesh, source_size, source_time))
+            std::cerr << "Could not write the mesh cache " << cache_path << std::endl;
+    }
+
+    if (stats)
+    {
+        stats->from_cache = from_cache;
+        stats->load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+        stats->triangles = mesh->get_data().triangle_count;
+        stats->heap_bytes = mesh->memory_size();
+        stats->mapped_bytes = mesh->mapped_memory_size();
+    }
+    return mesh;
+}
@@ -0,0 +1,45 @@
+#ifndef MESH_IO_H
+#define MESH_IO_H
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mesh.h"
+
+/*
+* what load_mesh did and how long it took
+*/
+struct MeshLoadStats
+{
+    bool from_cache = false;
+    double load_ms = 0;
+    uint32_t triangles = 0;
+    // heap memory of the mesh buffers and size of the mapped cache file
+    size_t heap_bytes = 0;
+    size_t mapped_bytes = 0;
+};
+
+/*
+* Parse a Wavefront OBJ file. v, vn and f records are read, polygons are split into triangle fans and vertices
+* are shared between faces that reference the same position/normal pair. Prints an error and returns nullptr
+* if the file can not be read.
+*/
+std::unique_ptr<TriangleMesh> load_obj(const std::string &path, uint32_t material);
+
+/*
+* Binary cache of a mesh including its hierarchy. The buffers are aligned so the file can be mapped and used in
+* place. source_size and source_time identify the file the mesh was loaded from, a cache with a different stamp
+* is treated as outdated.
+*/
+bool save_mesh_cache(const std::string &path, const TriangleMesh &mesh, uint64_t source_size, int64_t source_time);
+// map a cache file, returns nullptr if it is missing, outdated or invalid
+std::unique_ptr<TriangleMesh> load_mesh_cache(const std::string &path, uint32_t material, uint64_t source_size, int64_t source_time);
+
+/*
+* Load an OBJ file through the cache file path + ".rtmesh". The first run parses the OBJ and writes the cache,
+* later runs map the cache as long as the OBJ did not change. material is an index into the material pool of the
+* scene the mesh is added to.
+*/
+std::unique_ptr<TriangleMesh> load_mesh(const std::string &path, uint32_t material, MeshLoadStats *stats = nullptr);
+
+#endif
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+#include "offline.h"
+#include "progressive.h"
+#include "image_io.h"
+#include "profiler.h"
+
+std::string frame_path(const std::string &output, int frame, int frames)
+{
+    if (frames == 1)
+        return output;
+    char number[16];
+    snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = output.find_last_of('.');
+    return dot == std::string::npos ? output + number : output.substr(0, dot) + number + output.substr(dot);
+}
+
+PixelPrecision band_precision(const OfflineOptions &options)
+{
+    return options.samples > 1 ? PixelPrecision::Float : options.precision;
+}
+
+RenderStats render_band(std::vector<vec3> u, const Scene &scene, const BVH &bvh, const Camera &cam, Framebuffer &band,
+                        ThreadPool &pool, const RenderSettings &settings, const OfflineOptions &options,
+                        int first_row, int rows, AdaptiveStats &adaptive_stats)
+{
+    PROFILE_STAGE("trace band");
+    RenderStats render_stats;
+    if (options.adaptive && options.samples <= 1)
+    {
+        AdaptiveStats stats = rt_adaptive(u, scene, bvh, cam, band, pool, settings, options.adaptive_settings, first_row, rows);
+        adaptive_stats.primary_rays += stats.primary_rays;
+        adaptive_stats.extra_rays += stats.extra_rays;
+        adaptive_stats.budget_rays += stats.budget_rays;
+        adaptive_stats.edge_pixels += stats.edge_pixels;
+        adaptive_stats.refined_pixels += stats.refined_pixels;
+        adaptive_stats.segments += stats.segments;
+        render_stats.paths += stats.primary_rays + stats.extra_rays;
+        render_stats.segments += stats.segments;
+    }
+    else
+    {
+        for (int sample = 0; sample < std::max(options.samples, 1); sample++)
+        {
+            RenderStats stats = rt_rows(u, scene, bvh, cam, band, pool, sample_settings(settings, sample), first_row, rows);
+            render_stats.paths += stats.paths;
+            render_stats.segments += stats.segments;
+        }
+    }
+    return render_stats;
+}
+
+int render_offline(const Scene &scene, const BVH &bvh, Camera cam,
+                   ThreadPool &pool, const RenderSettings &settings, const OfflineOptions &options)
+{
+    for (int frame = 0; frame < options.frames; frame++)
+    {
+        auto u = cam.init();
+        int width = cam.image_width;
+        int height = cam.image_height;
+        std::string path = frame_path(options.output, frame, options.frames);
+
+        auto writer = open_image_writer(path, width, height);
+        if (!writer)
+            return 1;
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        AdaptiveStats frame_stats;
+        RenderStats render_stats;
+        Framebuffer band(width, BAND_HEIGHT, band_precision(options));
+        for (int first_row = 0; first_row < height; first_row += BAND_HEIGHT)
+        {
+            int rows = std::min(BAND_HEIGHT, height - first_row);
+            RenderStats stats = render_band(u, scene, bvh, cam, band, pool, settings, options, first_row, rows, frame_stats);
+            render_stats.paths += stats.paths;
+            render_stats.segments += stats.segments;
+            PROFILE_STAGE("write band");
+            for (int i = 0; i < rows; i++)
+            {
+                if (!writer->write_row(band, i))
+                {
+                    std::cerr << "Writing " << path << " failed" << std::endl;
+                    return 1;
+                }
+            }
+        }
+        if (!writer->finish())
+        {
+            std::cerr << "Writing " << path << " failed" << std::endl;
+            return 1;
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::cout << path << ": " << width << "x" << height << " in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << " ms, "
+                  << render_stats.average_bounces() << " ray segments per path\n";
+        if (options.adaptive && options.samples <= 1)
+        {
+            std::cout << "   adaptive anti-aliasing: " << frame_stats.refined_pixels << " of " << frame_stats.edge_pixels << " edge pixels refined, "
+                      << frame_stats.extra_rays << " extra rays (budget " << frame_stats.budget_rays << ") on "
+                      << frame_stats.primary_rays << " primary rays\n";
+        }
+
+        cam.forward();
+    }
+    if (options.profile)
+        Profiler::get().report(std::cout);
+    return 0;
+}
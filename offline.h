@@ -0,0 +1,50 @@
+#ifndef OFFLINE_H
+#define OFFLINE_H
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "adaptive.h"
+
+struct OfflineOptions
+{
+    // .ppm, .pfm or .png. With several frames the frame number is inserted before the extension
+    std::string output = "render.ppm";
+    int frames = 1;
+    PixelPrecision precision = PixelPrecision::Float;
+    // jittered samples per pixel averaged into every frame, more than 1 anti-aliases the edges
+    int samples = 1;
+    // supersample the edges of a single sample render
+    bool adaptive = false;
+    AdaptiveSettings adaptive_settings;
+    // print the stage timings and ray counters after the last frame
+    bool profile = false;
+};
+
+// rows rendered and written together, several tiles high so every band still has work for all threads
+constexpr int BAND_HEIGHT = 4 * TILE_SIZE;
+
+// output path of a frame, with several frames the frame number is inserted before the extension
+std::string frame_path(const std::string &output, int frame, int frames);
+
+// precision of the band buffers, a running mean over several samples needs floats
+PixelPrecision band_precision(const OfflineOptions &options);
+
+/*
+* Render the rows [first_row, first_row + rows) of a frame into the rows [0, rows) of band with the samples or
+* the adaptive anti-aliasing of the options. The adaptive statistics are only added to when it is used.
+*/
+RenderStats render_band(std::vector<vec3> u, const Scene &scene, const BVH &bvh, const Camera &cam, Framebuffer &band,
+                        ThreadPool &pool, const RenderSettings &settings, const OfflineOptions &options,
+                        int first_row, int rows, AdaptiveStats &adaptive_stats);
+
+/*
+* Headless front end. Renders the frames in bands of rows that are written to disk as soon as they are done,
+* so memory use does not grow with the image height. Between frames the camera moves forward by its
+* movement speed. Returns the process exit code.
+*/
+int render_offline(const Scene &scene, const BVH &bvh, Camera cam,
+                   ThreadPool &pool, const RenderSettings &settings, const OfflineOptions &options);
+
+#endif
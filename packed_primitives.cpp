@@ -0,0 +1,329 @@
+#include "packed_primitives.h"
+#include "packet.h"
+#include <cmath>
+#if SIMD_WIDTH > 1
+#include <immintrin.h>
+#endif
+
+void PackedSpheres::clear()
+{
+    center_x.clear();
+    center_y.clear();
+    center_z.clear();
+    radius_squared.clear();
+    object_index.clear();
+    material.clear();
+}
+
+void PackedSpheres::add(const Sphere &sphere, int index)
+{
+    center_x.push_back(0);
+    center_y.push_back(0);
+    center_z.push_back(0);
+    radius_squared.push_back(0);
+    object_index.push_back(index);
+    material.push_back(0);
+    set(object_index.size() - 1, sphere);
+}
+
+void PackedSpheres::set(int slot, const Sphere &sphere)
+{
+    point3 center = sphere.get_center();
+    center_x[slot] = center.x;
+    center_y[slot] = center.y;
+    center_z[slot] = center.z;
+    radius_squared[slot] = sphere.get_radius_squared();
+    material[slot] = sphere.material_index();
+}
+
+size_t PackedSpheres::memory_size() const
+{
+    return (center_x.capacity() + center_y.capacity() + center_z.capacity() + radius_squared.capacity()) * sizeof(double) +
+           object_index.capacity() * sizeof(int) + material.capacity() * sizeof(uint32_t);
+}
+
+void PackedSpheres::pad()
+{
+    while (size() % SIMD_WIDTH != 0)
+    {
+        center_x.push_back(0);
+        center_y.push_back(0);
+        center_z.push_back(0);
+        // a negative squared radius makes the discriminant negative for every ray
+        radius_squared.push_back(-1);
+        object_index.push_back(-1);
+        material.push_back(0);
+    }
+}
+
+int PackedSpheres::intersect(const point3 &origin, const vec3 &direction, int first, int count, double &t_max) const
+{
+    double a = direction.length_squared();
+    double inv_a = 1. / a;
+    int best_slot = -1;
+
+#if SIMD_WIDTH == 4
+    __m256d ox = _mm256_set1_pd(origin.x), oy = _mm256_set1_pd(origin.y), oz = _mm256_set1_pd(origin.z);
+    __m256d dx = _mm256_set1_pd(direction.x), dy = _mm256_set1_pd(direction.y), dz = _mm256_set1_pd(direction.z);
+    __m256d va = _mm256_set1_pd(a), vinv_a = _mm256_set1_pd(inv_a);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d best_t = _mm256_set1_pd(t_max);
+    __m256d best_index = _mm256_set1_pd(-1);
+    __m256d lane_index = _mm256_set_pd(first + 3, first + 2, first + 1, first);
+    __m256d step = _mm256_set1_pd(4);
+
+    for (int i = first; i < first + count; i += 4)
+    {
+        __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(&center_x[i]));
+        __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(&center_y[i]));
+        __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(&center_z[i]));
+
+        __m256d half_b = _mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_add_pd(_mm256_mul_pd(dy, ocy), _mm256_mul_pd(dz, ocz)));
+        __m256d oc2 = _mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_add_pd(_mm256_mul_pd(ocy, ocy), _mm256_mul_pd(ocz, ocz)));
+        __m256d c = _mm256_sub_pd(oc2, _mm256_loadu_pd(&radius_squared[i]));
+        __m256d det = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(va, c));
+
+        __m256d root = _mm256_sqrt_pd(_mm256_max_pd(det, zero));
+        __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_sub_pd(zero, half_b), root), vinv_a);
+
+        __m256d mask = _mm256_and_pd(_mm256_cmp_pd(det, zero, _CMP_GE_OQ),
+                                     _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GT_OQ), _mm256_cmp_pd(t, best_t, _CMP_LT_OQ)));
+        best_t = _mm256_blendv_pd(best_t, t, mask);
+        best_index = _mm256_blendv_pd(best_index, lane_index, mask);
+        lane_index = _mm256_add_pd(lane_index, step);
+    }
+
+    alignas(32) double lane_t[4], lane_slot[4];
+    _mm256_store_pd(lane_t, best_t);
+    _mm256_store_pd(lane_slot, best_index);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        if (lane_slot[lane] >= 0 && lane_t[lane] < t_max)
+        {
+            t_max = lane_t[lane];
+            best_slot = static_cast<int>(lane_slot[lane]);
+        }
+    }
+#elif SIMD_WIDTH == 2
+    __m128d ox = _mm_set1_pd(origin.x), oy = _mm_set1_pd(origin.y), oz = _mm_set1_pd(origin.z);
+    __m128d dx = _mm_set1_pd(direction.x), dy = _mm_set1_pd(direction.y), dz = _mm_set1_pd(direction.z);
+    __m128d va = _mm_set1_pd(a), vinv_a = _mm_set1_pd(inv_a);
+    __m128d zero = _mm_setzero_pd();
+    __m128d best_t = _mm_set1_pd(t_max);
+    __m128d best_index = _mm_set1_pd(-1);
+    __m128d lane_index = _mm_set_pd(first + 1, first);
+    __m128d step = _mm_set1_pd(2);
+
+    for (int i = first; i < first + count; i += 2)
+    {
+        __m128d ocx = _mm_sub_pd(ox, _mm_loadu_pd(&center_x[i]));
+        __m128d ocy = _mm_sub_pd(oy, _mm_loadu_pd(&center_y[i]));
+        __m128d ocz = _mm_sub_pd(oz, _mm_loadu_pd(&center_z[i]));
+
+        __m128d half_b = _mm_add_pd(_mm_mul_pd(dx, ocx), _mm_add_pd(_mm_mul_pd(dy, ocy), _mm_mul_pd(dz, ocz)));
+        __m128d oc2 = _mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_add_pd(_mm_mul_pd(ocy, ocy), _mm_mul_pd(ocz, ocz)));
+        __m128d c = _mm_sub_pd(oc2, _mm_loadu_pd(&radius_squared[i]));
+        __m128d det = _mm_sub_pd(_mm_mul_pd(half_b, half_b), _mm_mul_pd(va, c));
+
+        __m128d root = _mm_sqrt_pd(_mm_max_pd(det, zero));
+        __m128d t = _mm_mul_pd(_mm_sub_pd(_mm_sub_pd(zero, half_b), root), vinv_a);
+
+        __m128d mask = _mm_and_pd(_mm_cmpge_pd(det, zero), _mm_and_pd(_mm_cmpgt_pd(t, zero), _mm_cmplt_pd(t, best_t)));
+        best_t = _mm_or_pd(_mm_and_pd(mask, t), _mm_andnot_pd(mask, best_t));
+        best_index = _mm_or_pd(_mm_and_pd(mask, lane_index), _mm_andnot_pd(mask, best_index));
+        lane_index = _mm_add_pd(lane_index, step);
+    }
+
+    alignas(16) double lane_t[2], lane_slot[2];
+    _mm_store_pd(lane_t, best_t);
+    _mm_store_pd(lane_slot, best_index);
+    for (int lane = 0; lane < 2; lane++)
+    {
+        if (lane_slot[lane] >= 0 && lane_t[lane] < t_max)
+        {
+            t_max = lane_t[lane];
+            best_slot = static_cast<int>(lane_slot[lane]);
+        }
+    }
+#else
+    for (int i = first; i < first + count; i++)
+    {
+        double ocx = origin.x - center_x[i], ocy = origin.y - center_y[i], ocz = origin.z - center_z[i];
+        double half_b = direction.x * ocx + direction.y * ocy + direction.z * ocz;
+        double c = ocx * ocx + ocy * ocy + ocz * ocz - radius_squared[i];
+        double det = half_b * half_b - a * c;
+        if (det < 0)
+            continue;
+        double t = (-half_b - std::sqrt(det)) * inv_a;
+        if (t > 0 && t < t_max)
+        {
+            t_max = t;
+            best_slot = i;
+        }
+    }
+#endif
+    return best_slot;
+}
+
+void PackedSpheres::intersect_packet(const RayPacket &packet, uint32_t lanes, int first, int count, double *t_max, int *slot) const
+{
+    const point3 &origin = packet.origin;
+#if SIMD_WIDTH == 4
+    __m256d zero = _mm256_setzero_pd();
+    for (int lane = 0; lane < PACKET_SIZE; lane += 4)
+    {
+        uint32_t group = (lanes >> lane) & 0xF;
+        if (group == 0)
+            continue;
+        __m256d group_mask = _mm256_castsi256_pd(_mm256_set_epi64x(-(int64_t)((group >> 3) & 1), -(int64_t)((group >> 2) & 1),
+                                                                   -(int64_t)((group >> 1) & 1), -(int64_t)(group & 1)));
+        __m256d dx = _mm256_load_pd(&packet.direction_x[lane]);
+        __m256d dy = _mm256_load_pd(&packet.direction_y[lane]);
+        __m256d dz = _mm256_load_pd(&packet.direction_z[lane]);
+        __m256d a = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_add_pd(_mm256_mul_pd(dy, dy), _mm256_mul_pd(dz, dz)));
+        __m256d inv_a = _mm256_div_pd(_mm256_set1_pd(1.), a);
+        __m256d best_t = _mm256_loadu_pd(&t_max[lane]);
+        __m256d best_slot = _mm256_set1_pd(-1);
+
+        for (int i = first; i < first + count; i++)
+        {
+            if (object_index[i] < 0)
+                continue;
+            // all lanes share the origin, so everything that does not depend on the direction is scalar
+            double ocx = origin.x - center_x[i], ocy = origin.y - center_y[i], ocz = origin.z - center_z[i];
+            double c = ocx * ocx + ocy * ocy + ocz * ocz - radius_squared[i];
+
+            __m256d half_b = _mm256_add_pd(_mm256_mul_pd(dx, _mm256_set1_pd(ocx)),
+                                           _mm256_add_pd(_mm256_mul_pd(dy, _mm256_set1_pd(ocy)), _mm256_mul_pd(dz, _mm256_set1_pd(ocz))));
+            __m256d det = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(a, _mm256_set1_pd(c)));
+            __m256d root = _mm256_sqrt_pd(_mm256_max_pd(det, zero));
+            __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_sub_pd(zero, half_b), root), inv_a);
+
+            __m256d mask = _mm256_and_pd(_mm256_and_pd(group_mask, _mm256_cmp_pd(det, zero, _CMP_GE_OQ)),
+                                         _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GT_OQ), _mm256_cmp_pd(t, best_t, _CMP_LT_OQ)));
+            best_t = _mm256_blendv_pd(best_t, t, mask);
+            best_slot = _mm256_blendv_pd(best_slot, _mm256_set1_pd(i), mask);
+        }
+
+        alignas(32) double lane_slot[4];
+        _mm256_storeu_pd(&t_max[lane], best_t);
+        _mm256_store_pd(lane_slot, best_slot);
+        for (int l = 0; l < 4; l++)
+        {
+            if (lane_slot[l] >= 0)
+                slot[lane + l] = static_cast<int>(lane_slot[l]);
+        }
+    }
+#else
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        if (!(lanes & (1u << lane)))
+            continue;
+        vec3 direction(packet.direction_x[lane], packet.direction_y[lane], packet.direction_z[lane]);
+        int hit_slot = intersect(origin, direction, first, count, t_max[lane]);
+        if (hit_slot >= 0)
+            slot[lane] = hit_slot;
+    }
+#endif
+}
+
+Collision PackedSpheres::collision(const ray &r, int slot, double t) const
+{
+    vec3 normal = r.at(t) - point3(center_x[slot], center_y[slot], center_z[slot]);
+    Collision col(t, normal.normalize(), true, object_index[slot]);
+    col.material = material[slot];
+    return col;
+}
+
+void PackedPlanes::clear()
+{
+    for (auto *values : {&origin_x, &origin_y, &origin_z, &normal_x, &normal_y, &normal_z,
+                         &axis_u_x, &axis_u_y, &axis_u_z, &axis_v_x, &axis_v_y, &axis_v_z, &offset})
+    {
+        values->clear();
+    }
+    disk.clear();
+    object_index.clear();
+    material.clear();
+}
+
+void PackedPlanes::add(const PlanarGeometry &plane, int index)
+{
+    for (auto *values : {&origin_x, &origin_y, &origin_z, &normal_x, &normal_y, &normal_z,
+                         &axis_u_x, &axis_u_y, &axis_u_z, &axis_v_x, &axis_v_y, &axis_v_z, &offset})
+    {
+        values->push_back(0);
+    }
+    disk.push_back(0);
+    object_index.push_back(index);
+    material.push_back(0);
+    set(object_index.size() - 1, plane);
+}
+
+size_t PackedPlanes::memory_size() const
+{
+    size_t bytes = object_index.capacity() * sizeof(int) + material.capacity() * sizeof(uint32_t) + disk.capacity();
+    for (auto *values : {&origin_x, &origin_y, &origin_z, &normal_x, &normal_y, &normal_z,
+                         &axis_u_x, &axis_u_y, &axis_u_z, &axis_v_x, &axis_v_y, &axis_v_z, &offset})
+    {
+        bytes += values->capacity() * sizeof(double);
+    }
+    return bytes;
+}
+
+void PackedPlanes::set(int slot, const PlanarGeometry &plane)
+{
+    const PlanarRecord &record = plane.get_record();
+    origin_x[slot] = record.origin.x;
+    origin_y[slot] = record.origin.y;
+    origin_z[slot] = record.origin.z;
+    normal_x[slot] = record.normal.x;
+    normal_y[slot] = record.normal.y;
+    normal_z[slot] = record.normal.z;
+    axis_u_x[slot] = record.axis_u.x;
+    axis_u_y[slot] = record.axis_u.y;
+    axis_u_z[slot] = record.axis_u.z;
+    axis_v_x[slot] = record.axis_v.x;
+    axis_v_y[slot] = record.axis_v.y;
+    axis_v_z[slot] = record.axis_v.z;
+    offset[slot] = record.offset;
+    disk[slot] = record.disk;
+    material[slot] = plane.material_index();
+}
+
+int PackedPlanes::intersect(const point3 &origin, const vec3 &direction, int first, int count, double &t_max) const
+{
+    int best_slot = -1;
+    for (int i = first; i < first + count; i++)
+    {
+        double denominator = normal_x[i] * direction.x + normal_y[i] * direction.y + normal_z[i] * direction.z;
+        // rays parallel to the plane never hit it
+        if (denominator == 0)
+            continue;
+
+        double t = (offset[i] - (normal_x[i] * origin.x + normal_y[i] * origin.y + normal_z[i] * origin.z)) / denominator;
+        if (t <= 0 || t >= t_max)
+            continue;
+
+        // vector from the plane origin to the intersection point, in the local coordinates of the primitive
+        double wx = origin.x + direction.x * t - origin_x[i];
+        double wy = origin.y + direction.y * t - origin_y[i];
+        double wz = origin.z + direction.z * t - origin_z[i];
+        double u = wx * axis_u_x[i] + wy * axis_u_y[i] + wz * axis_u_z[i];
+        double v = wx * axis_v_x[i] + wy * axis_v_y[i] + wz * axis_v_z[i];
+        bool inside = disk[i] ? u * u + v * v <= 1 : u >= 0 && u <= 1 && v >= 0 && v <= 1;
+        if (inside)
+        {
+            t_max = t;
+            best_slot = i;
+        }
+    }
+    return best_slot;
+}
+
+Collision PackedPlanes::collision(int slot, double t) const
+{
+    Collision col(t, vec3(normal_x[slot], normal_y[slot], normal_z[slot]), true, object_index[slot]);
+    col.material = material[slot];
+    return col;
+}
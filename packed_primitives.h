@@ -0,0 +1,76 @@
+#ifndef PACKED_PRIMITIVES_H
+#define PACKED_PRIMITIVES_H
+#include "scene.h"
+#include <cstdint>
+#include <vector>
+
+struct RayPacket;
+
+// number of primitives tested at once by the intersection kernels
+#if defined(__AVX2__)
+#define SIMD_WIDTH 4
+#elif defined(__SSE2__)
+#define SIMD_WIDTH 2
+#else
+#define SIMD_WIDTH 1
+#endif
+
+/*
+* Structure of arrays copy of sphere data. Blocks are padded to a multiple of SIMD_WIDTH
+* with spheres that can never be hit, so the kernel never needs a scalar remainder loop.
+*/
+struct PackedSpheres
+{
+    std::vector<double> center_x, center_y, center_z, radius_squared;
+    // index of the sphere in the scene, -1 for padding
+    std::vector<int> object_index;
+    // material pool index, so a hit never has to touch the object
+    std::vector<uint32_t> material;
+
+    void clear();
+    size_t size() const { return object_index.size(); }
+    void add(const Sphere &sphere, int index);
+    void set(int slot, const Sphere &sphere);
+    size_t memory_size() const;
+    // fill up the current block to a multiple of SIMD_WIDTH
+    void pad();
+
+    /*
+    * Test the ray against the slots [first, first + count). Returns the slot of the closest hit
+    * with a distance in (0, t_max) and writes its distance to t_max, or -1 if nothing was hit.
+    */
+    int intersect(const point3 &origin, const vec3 &direction, int first, int count, double &t_max) const;
+    /*
+    * Test the lanes of a packet against the slots [first, first + count), with the rays in the SIMD lanes.
+    * For every lane with a closer hit than t_max[lane] the distance and slot are written to t_max and slot.
+    */
+    void intersect_packet(const RayPacket &packet, uint32_t lanes, int first, int count, double *t_max, int *slot) const;
+    Collision collision(const ray &r, int slot, double t) const;
+};
+
+/*
+* Structure of arrays copy of the PlanarRecord of walls, quads and disks
+*/
+struct PackedPlanes
+{
+    std::vector<double> origin_x, origin_y, origin_z;
+    std::vector<double> normal_x, normal_y, normal_z;
+    std::vector<double> axis_u_x, axis_u_y, axis_u_z;
+    std::vector<double> axis_v_x, axis_v_y, axis_v_z;
+    std::vector<double> offset;
+    std::vector<uint8_t> disk;
+    std::vector<int> object_index;
+    std::vector<uint32_t> material;
+
+    void clear();
+    size_t size() const { return object_index.size(); }
+    void add(const PlanarGeometry &plane, int index);
+    void set(int slot, const PlanarGeometry &plane);
+    size_t memory_size() const;
+
+    // same contract as PackedSpheres::intersect
+    int intersect(const point3 &origin, const vec3 &direction, int first, int count, double &t_max) const;
+    Collision collision(int slot, double t) const;
+};
+
+#endif
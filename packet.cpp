@@ -0,0 +1,118 @@
+#include "packet.h"
+#include "packed_primitives.h"
+#include <algorithm>
+#if SIMD_WIDTH == 4
+#include <immintrin.h>
+#endif
+
+void RayPacket::set_direction(int lane, const vec3 &direction)
+{
+    direction_x[lane] = direction.x;
+    direction_y[lane] = direction.y;
+    direction_z[lane] = direction.z;
+}
+
+void RayPacket::finalize()
+{
+    vec3 center(0, 0, 0);
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        inv_direction_x[lane] = 1. / direction_x[lane];
+        inv_direction_y[lane] = 1. / direction_y[lane];
+        inv_direction_z[lane] = 1. / direction_z[lane];
+        center = center + vec3(direction_x[lane], direction_y[lane], direction_z[lane]);
+    }
+
+    // the lanes form a regular grid, so the four corner rays span the frustum
+    int corners[4] = {0, PACKET_WIDTH - 1, PACKET_SIZE - 1, PACKET_SIZE - PACKET_WIDTH};
+    for (int i = 0; i < 4; i++)
+    {
+        vec3 normal = vec3::cross(lane_ray(corners[i]).get_direction(), lane_ray(corners[(i + 1) % 4]).get_direction()).normalize();
+        frustum[i] = vec3::dot(normal, center) < 0 ? -normal : normal;
+    }
+}
+
+ray RayPacket::lane_ray(int lane) const
+{
+    return ray(vec3(direction_x[lane], direction_y[lane], direction_z[lane]), origin);
+}
+
+bool RayPacket::frustum_culls(const AABB &box) const
+{
+    for (const vec3 &normal : frustum)
+    {
+        // the box corner farthest along the plane normal decides whether any part of the box is inside
+        point3 corner(normal.x > 0 ? box.max.x : box.min.x,
+                      normal.y > 0 ? box.max.y : box.min.y,
+                      normal.z > 0 ? box.max.z : box.min.z);
+        if (vec3::dot(normal, corner - origin) < -1e-9)
+            return true;
+    }
+    return false;
+}
+
+uint32_t RayPacket::intersect(const AABB &box, uint32_t lanes, const double *t_max, double &t_entry) const
+{
+    uint32_t hits = 0;
+    t_entry = DBL_MAX;
+
+#if SIMD_WIDTH == 4
+    __m256d min_x = _mm256_set1_pd(box.min.x - origin.x), max_x = _mm256_set1_pd(box.max.x - origin.x);
+    __m256d min_y = _mm256_set1_pd(box.min.y - origin.y), max_y = _mm256_set1_pd(box.max.y - origin.y);
+    __m256d min_z = _mm256_set1_pd(box.min.z - origin.z), max_z = _mm256_set1_pd(box.max.z - origin.z);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d entry = _mm256_set1_pd(DBL_MAX);
+
+    for (int lane = 0; lane < PACKET_SIZE; lane += 4)
+    {
+        if (((lanes >> lane) & 0xF) == 0)
+            continue;
+        __m256d inv_x = _mm256_load_pd(&inv_direction_x[lane]);
+        __m256d inv_y = _mm256_load_pd(&inv_direction_y[lane]);
+        __m256d inv_z = _mm256_load_pd(&inv_direction_z[lane]);
+
+        __m256d tx1 = _mm256_mul_pd(min_x, inv_x), tx2 = _mm256_mul_pd(max_x, inv_x);
+        __m256d ty1 = _mm256_mul_pd(min_y, inv_y), ty2 = _mm256_mul_pd(max_y, inv_y);
+        __m256d tz1 = _mm256_mul_pd(min_z, inv_z), tz2 = _mm256_mul_pd(max_z, inv_z);
+
+        __m256d t_near = _mm256_max_pd(_mm256_min_pd(tx1, tx2), _mm256_max_pd(_mm256_min_pd(ty1, ty2), _mm256_min_pd(tz1, tz2)));
+        __m256d t_far = _mm256_min_pd(_mm256_max_pd(tx1, tx2), _mm256_min_pd(_mm256_max_pd(ty1, ty2), _mm256_max_pd(tz1, tz2)));
+        t_near = _mm256_max_pd(t_near, zero);
+
+        __m256d mask = _mm256_and_pd(_mm256_cmp_pd(t_near, t_far, _CMP_LE_OQ),
+                                     _mm256_cmp_pd(t_near, _mm256_load_pd(&t_max[lane]), _CMP_LT_OQ));
+        uint32_t lane_hits = (_mm256_movemask_pd(mask) & (lanes >> lane)) & 0xF;
+        if (lane_hits)
+        {
+            hits |= lane_hits << lane;
+            // only lanes that hit may lower the entry distance
+            __m256d hit_lanes = _mm256_castsi256_pd(_mm256_set_epi64x(-(int64_t)((lane_hits >> 3) & 1), -(int64_t)((lane_hits >> 2) & 1),
+                                                                      -(int64_t)((lane_hits >> 1) & 1), -(int64_t)(lane_hits & 1)));
+            entry = _mm256_blendv_pd(entry, _mm256_min_pd(entry, t_near), hit_lanes);
+        }
+    }
+    if (hits)
+    {
+        alignas(32) double lane_entry[4];
+        _mm256_store_pd(lane_entry, entry);
+        t_entry = std::min(std::min(lane_entry[0], lane_entry[1]), std::min(lane_entry[2], lane_entry[3]));
+    }
+#else
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        if (!(lanes & (1u << lane)))
+            continue;
+        double tx1 = (box.min.x - origin.x) * inv_direction_x[lane], tx2 = (box.max.x - origin.x) * inv_direction_x[lane];
+        double ty1 = (box.min.y - origin.y) * inv_direction_y[lane], ty2 = (box.max.y - origin.y) * inv_direction_y[lane];
+        double tz1 = (box.min.z - origin.z) * inv_direction_z[lane], tz2 = (box.max.z - origin.z) * inv_direction_z[lane];
+        double t_near = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.));
+        double t_far = std::min(std::max(tx1, tx2), std::min(std::max(ty1, ty2), std::max(tz1, tz2)));
+        if (t_near <= t_far && t_near < t_max[lane])
+        {
+            hits |= 1u << lane;
+            t_entry = std::min(t_entry, t_near);
+        }
+    }
+#endif
+    return hits;
+}
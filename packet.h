@@ -0,0 +1,40 @@
+#ifndef PACKET_H
+#define PACKET_H
+#include "scene.h"
+#include <cstdint>
+
+// a packet covers PACKET_WIDTH x PACKET_WIDTH neighbouring pixels
+#define PACKET_WIDTH 4
+constexpr int PACKET_SIZE = PACKET_WIDTH * PACKET_WIDTH;
+
+/*
+* Coherent rays with a common origin, i.e. the primary rays of a block of pixels. Directions are stored
+* as structure of arrays so the box and sphere tests can run over several rays at once.
+* Lanes that are not set in the active mask (pixels outside the image) still hold a valid direction,
+* so the frustum built from the corner lanes always bounds the whole packet.
+*/
+struct RayPacket
+{
+    point3 origin;
+    alignas(32) double direction_x[PACKET_SIZE], direction_y[PACKET_SIZE], direction_z[PACKET_SIZE];
+    alignas(32) double inv_direction_x[PACKET_SIZE], inv_direction_y[PACKET_SIZE], inv_direction_z[PACKET_SIZE];
+    // one bit per lane
+    uint32_t active = 0;
+    // normals of the four side planes through the origin, every ray of the packet is on their positive side
+    vec3 frustum[4];
+
+    void set_direction(int lane, const vec3 &direction);
+    // compute the inverse directions and the frustum once all lanes are set
+    void finalize();
+
+    ray lane_ray(int lane) const;
+    // true if the box is completely outside the frustum of the packet
+    bool frustum_culls(const AABB &box) const;
+    /*
+    * Slab test of all lanes in the mask. Returns the lanes whose entry distance is closer than their t_max
+    * and writes the smallest entry distance of those lanes to t_entry.
+    */
+    uint32_t intersect(const AABB &box, uint32_t lanes, const double *t_max, double &t_entry) const;
+};
+
+#endif
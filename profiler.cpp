@@ -0,0 +1,210 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+int64_t clock_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// names are string literals and thread names, only quotes and backslashes need escaping
+std::string json_string(const std::string &text)
+{
+    std::string escaped = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+double percentile(std::vector<int64_t> &samples, double fraction)
+{
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index] / 1e6;
+}
+}
+
+Profiler::Profiler() : start_ns{clock_ns()} {}
+
+Profiler &Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+int64_t Profiler::now_ns() const
+{
+    return clock_ns() - start_ns;
+}
+
+int Profiler::stage(const char *name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int count = stage_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        if (stages[i].name == name)
+            return i;
+    }
+    if (count == MAX_STAGES)
+        return MAX_STAGES - 1;
+    stages[count].name = name;
+    stage_count.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+void Profiler::add_sample(int stage, int64_t duration_ns)
+{
+    Stage &target = stages[stage];
+    std::lock_guard<std::mutex> lock(target.mutex);
+    target.window[target.samples % WINDOW] = duration_ns;
+    target.samples++;
+    target.total_ns += duration_ns;
+}
+
+StageSummary Profiler::summary(int stage) const
+{
+    const Stage &source = stages[stage];
+    StageSummary result;
+    result.name = source.name;
+    std::vector<int64_t> window;
+    {
+        std::lock_guard<std::mutex> lock(source.mutex);
+        result.samples = source.samples;
+        if (source.samples == 0)
+            return result;
+        result.mean_ms = source.total_ns / 1e6 / source.samples;
+        window.assign(source.window, source.window + std::min<uint64_t>(source.samples, WINDOW));
+    }
+    result.p50_ms = percentile(window, .5);
+    result.p95_ms = percentile(window, .95);
+    result.p99_ms = percentile(window, .99);
+    return result;
+}
+
+std::vector<StageSummary> Profiler::summaries() const
+{
+    int count = stage_count.load(std::memory_order_acquire);
+    std::vector<StageSummary> result;
+    for (int i = 0; i < count; i++)
+        result.push_back(summary(i));
+    return result;
+}
+
+Profiler::ThreadData &Profiler::thread()
+{
+    // the deque never moves its elements, so the pointer stays valid
+    thread_local ThreadData *data = nullptr;
+    if (!data)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.emplace_back();
+        data = &threads.back();
+        data->id = threads.size() - 1;
+        data->name = "thread " + std::to_string(data->id);
+    }
+    return *data;
+}
+
+void Profiler::set_thread_name(const std::string &name)
+{
+    ThreadData &data = thread();
+    std::lock_guard<std::mutex> lock(mutex);
+    data.name = name;
+}
+
+std::vector<ThreadSummary> Profiler::thread_summaries() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<ThreadSummary> result;
+    for (const ThreadData &data : threads)
+    {
+        ThreadSummary summary;
+        summary.name = data.name;
+        summary.rays = data.counters.rays.load(std::memory_order_relaxed);
+        summary.shadow_rays = data.counters.shadow_rays.load(std::memory_order_relaxed);
+        summary.intersection_tests = data.counters.intersection_tests.load(std::memory_order_relaxed);
+        summary.bounces = data.counters.bounces.load(std::memory_order_relaxed);
+        result.push_back(summary);
+    }
+    return result;
+}
+
+bool Profiler::write_trace(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const ThreadData &data : threads)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << data.id
+             << ",\"args\":{\"name\":" << json_string(data.name) << "}}";
+        first = false;
+        // complete events with microsecond timestamps
+        for (const TraceEvent &event : data.events)
+        {
+            file << ",\n{\"name\":" << json_string(event.name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << data.id
+                 << ",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+        }
+    }
+    file << "\n]}\n";
+    return file.good();
+}
+
+void Profiler::report(std::ostream &out) const
+{
+    out << std::fixed << std::setprecision(2);
+    out << "   stage                 samples     mean      p50      p95      p99 (ms, percentiles of the last " << WINDOW << ")\n";
+    for (const StageSummary &stage : summaries())
+    {
+        if (stage.samples == 0)
+            continue;
+        out << "   " << std::left << std::setw(20) << stage.name << std::right << std::setw(9) << stage.samples
+            << std::setw(9) << stage.mean_ms << std::setw(9) << stage.p50_ms << std::setw(9) << stage.p95_ms
+            << std::setw(9) << stage.p99_ms << "\n";
+    }
+    out << "   thread                   rays  shadow rays   intersection tests      bounces\n";
+    for (const ThreadSummary &thread : thread_summaries())
+    {
+        if (thread.rays + thread.shadow_rays == 0)
+            continue;
+        out << "   " << std::left << std::setw(16) << thread.name << std::right << std::setw(13) << thread.rays
+            << std::setw(13) << thread.shadow_rays << std::setw(21) << thread.intersection_tests << std::setw(13)
+            << thread.bounces << "\n";
+    }
+    out << std::defaultfloat;
+}
+
+ScopedTimer::ScopedTimer(const char *name, int stage) : name{name}, stage{stage}
+{
+    timed = stage >= 0 || Profiler::get().tracing();
+    if (timed)
+        start = Profiler::get().now_ns();
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if (!timed)
+        return;
+    Profiler &profiler = Profiler::get();
+    int64_t duration = profiler.now_ns() - start;
+    if (stage >= 0)
+        profiler.add_sample(stage, duration);
+    if (profiler.tracing())
+    {
+        std::vector<Profiler::TraceEvent> &events = profiler.thread().events;
+        if (events.size() < Profiler::MAX_TRACE_EVENTS)
+            events.push_back({name, start, duration});
+    }
+}
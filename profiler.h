@@ -0,0 +1,153 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+* Work counters of one thread. Only the owning thread writes them, with a relaxed load and store instead of a
+* locked add, so counting costs a plain add and other threads can still read them at any time.
+*/
+struct ThreadCounters
+{
+    std::atomic<uint64_t> rays{0};
+    std::atomic<uint64_t> shadow_rays{0};
+    // primitives tested in the leaves of the scene hierarchy
+    std::atomic<uint64_t> intersection_tests{0};
+    std::atomic<uint64_t> bounces{0};
+};
+
+inline void count(std::atomic<uint64_t> &counter, uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// statistics of one stage, the percentiles cover the last Profiler::WINDOW samples
+struct StageSummary
+{
+    std::string name;
+    uint64_t samples = 0;
+    double mean_ms = 0, p50_ms = 0, p95_ms = 0, p99_ms = 0;
+};
+
+// counters of one thread at the time of the call
+struct ThreadSummary
+{
+    std::string name;
+    uint64_t rays = 0, shadow_rays = 0, intersection_tests = 0, bounces = 0;
+};
+
+/*
+* Process wide instrumentation. Stages collect the durations of coarse steps like whole frames into rolling
+* windows for percentiles. While a trace is captured every timed scope also becomes an event in a buffer of
+* its thread, which write_trace exports in the Chrome trace event format (chrome://tracing, Perfetto).
+* Threads register themselves on first use and are never removed, like the workers of the pool.
+*/
+class Profiler
+{
+public:
+    // samples per stage kept for the percentiles
+    static constexpr size_t WINDOW = 256;
+    // events kept per thread, later ones are dropped
+    static constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+    static constexpr int MAX_STAGES = 64;
+
+    struct TraceEvent
+    {
+        const char *name;
+        int64_t start_ns, duration_ns;
+    };
+
+    struct ThreadData
+    {
+        int id;
+        std::string name;
+        ThreadCounters counters;
+        std::vector<TraceEvent> events;
+    };
+
+private:
+    struct Stage
+    {
+        std::string name;
+        mutable std::mutex mutex;
+        int64_t window[WINDOW];
+        uint64_t samples = 0;
+        int64_t total_ns = 0;
+    };
+
+    mutable std::mutex mutex;
+    // fixed storage, so recording a sample never races with the registration of another stage
+    Stage stages[MAX_STAGES];
+    std::atomic<int> stage_count{0};
+    std::deque<ThreadData> threads;
+    std::atomic<bool> trace_enabled{false};
+    int64_t start_ns;
+
+    Profiler();
+
+public:
+    static Profiler &get();
+
+    // id of the stage with this name, registered on first use. Stages beyond MAX_STAGES share the last id
+    int stage(const char *name);
+    void add_sample(int stage, int64_t duration_ns);
+    StageSummary summary(int stage) const;
+    std::vector<StageSummary> summaries() const;
+
+    // data of the calling thread
+    ThreadData &thread();
+    void set_thread_name(const std::string &name);
+    std::vector<ThreadSummary> thread_summaries() const;
+
+    void start_trace() { trace_enabled = true; }
+    bool tracing() const { return trace_enabled.load(std::memory_order_relaxed); }
+    // only call while no other thread records events, i.e. after the render loop ended
+    bool write_trace(const std::string &path) const;
+
+    // stage table and counters per thread
+    void report(std::ostream &out) const;
+
+    // nanoseconds since the profiler was created
+    int64_t now_ns() const;
+};
+
+// counters of the calling thread
+inline ThreadCounters &thread_counters()
+{
+    return Profiler::get().thread().counters;
+}
+
+/*
+* Times its own lifetime. With a stage id the duration goes into the stage statistics, while a trace is
+* captured it is also recorded as an event.
+*/
+class ScopedTimer
+{
+    const char *name;
+    int stage;
+    int64_t start = 0;
+    bool timed;
+
+public:
+    explicit ScopedTimer(const char *name, int stage = -1);
+    ~ScopedTimer();
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// trace event for the rest of the enclosing scope, costs one flag test when no trace is captured
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+// PROFILE_SCOPE that also adds the duration to the statistics of the stage
+#define PROFILE_STAGE(name)                                                                   \
+    static const int PROFILE_CONCAT(profile_stage_, __LINE__) = Profiler::get().stage(name); \
+    ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name, PROFILE_CONCAT(profile_stage_, __LINE__))
+
+#endif
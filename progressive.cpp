@@ -0,0 +1,68 @@
+#include "progressive.h"
+
+namespace
+{
+// radical inverse of index in the given base, the coordinates of the Halton sequence
+double halton(int index, int base)
+{
+    double result = 0;
+    double fraction = 1.0 / base;
+    while (index > 0)
+    {
+        result += (index % base) * fraction;
+        index /= base;
+        fraction /= base;
+    }
+    return result;
+}
+
+// samples traced before the change between samples is trusted as a convergence measure
+constexpr int MIN_CONVERGED_SAMPLES = 16;
+}
+
+RenderSettings sample_settings(const RenderSettings &settings, int sample)
+{
+    RenderSettings result = settings;
+    if (sample > 0)
+    {
+        result.jitter_x = halton(sample, 2) - 0.5;
+        result.jitter_y = halton(sample, 3) - 0.5;
+    }
+    result.sample_weight = 1.0 / (sample + 1);
+    return result;
+}
+
+ProgressiveRenderer::ProgressiveRenderer(int width, int height) : accumulation(width, height), previous(width, height)
+{
+}
+
+const ProgressiveStats &ProgressiveRenderer::render(std::vector<vec3> u, const Scene &scene,
+                                                    const BVH &bvh, const Camera &cam, ThreadPool &pool,
+                                                    const RenderSettings &settings, Framebuffer &output)
+{
+    if (!valid || cam.revision != camera_revision)
+    {
+        valid = true;
+        camera_revision = cam.revision;
+        current.samples_per_pixel = 0;
+        current.change = 0;
+        current.converged = false;
+        current.resets++;
+    }
+
+    current.average_bounces = 0;
+    if (!current.converged)
+    {
+        if (current.samples_per_pixel > 0)
+            previous.copy_from(accumulation);
+        current.average_bounces = rt_scene(u, scene, bvh, cam, accumulation, pool, sample_settings(settings, current.samples_per_pixel)).average_bounces();
+        current.samples_per_pixel++;
+        if (current.samples_per_pixel > 1)
+            current.change = accumulation.mean_difference(previous);
+        current.converged = current.samples_per_pixel >= max_samples ||
+                            (current.samples_per_pixel >= MIN_CONVERGED_SAMPLES && current.change < convergence_threshold);
+    }
+
+    output.copy_from(accumulation);
+    return current;
+}
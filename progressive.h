@@ -0,0 +1,56 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+#include <memory>
+#include <vector>
+
+#include "renderer.h"
+#include "framebuffer.h"
+
+struct ProgressiveStats
+{
+    int samples_per_pixel = 0;
+    // mean absolute change of a color channel caused by the last sample, it falls as the image converges
+    double change = 0;
+    // no more samples are traced until the view changes
+    bool converged = false;
+    // number of times the accumulated samples were thrown away
+    int resets = 0;
+    // ray segments per pixel traced by the last call, 0 once converged
+    double average_bounces = 0;
+};
+
+/*
+* settings for the sample with index sample (counting from 0) of a progressive render. The first sample goes
+* through the pixel centers, the following ones are jittered by a Halton (2, 3) sequence and weighted to keep
+* a running mean, which anti-aliases the edges.
+*/
+RenderSettings sample_settings(const RenderSettings &settings, int sample);
+
+/*
+* Accumulates jittered samples into a float buffer as long as the camera does not move. Every call to render
+* adds one sample per pixel, the accumulation restarts when the revision of the camera changed or reset() was
+* called. Once converged (max_samples reached or the image stopped changing) render() only copies the result.
+*/
+class ProgressiveRenderer
+{
+    Framebuffer accumulation, previous;
+    unsigned camera_revision = 0;
+    bool valid = false;
+    ProgressiveStats current;
+
+public:
+    int max_samples = 256;
+    // mean absolute change per sample below which the image counts as converged
+    double convergence_threshold = 1e-5;
+
+    ProgressiveRenderer(int width, int height);
+
+    // throw away the accumulated samples, i.e. after the scene changed
+    void reset() { valid = false; }
+    // add one sample seen from cam (unless converged) and copy the current estimate to output
+    const ProgressiveStats &render(std::vector<vec3> u, const Scene &scene, const BVH &bvh,
+                                   const Camera &cam, ThreadPool &pool, const RenderSettings &settings, Framebuffer &output);
+    const ProgressiveStats &stats() const { return current; }
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <atomic>
+
+#include "profiler.h"
+#include "wavefront.h"
+
+RGB out_color(vec3 v)
+{
+    if (v.z < 0.0){
+        return GROUND_COLOR;
+    }
+    v = v.normalize();
+    const float skyGradient = 1. / 4.;
+    vec3 skyColor = vec3::linear_interp(SKYCOLOR_LOW, SKYCOLOR_HIGH, std::pow(v.z, skyGradient));
+    return skyColor;
+}
+
+/*
+* Find the intersection of a ray with the scene that is closest to the ray origin
+*/
+Collision find_closest_hit(const Scene &scene, const BVH &bvh, ray r)
+{
+    return bvh.closest_hit(scene, r);
+}
+
+namespace
+{
+// lights of a render without a light set
+const LightSet &default_lights()
+{
+    static const LightSet lights({Light::point(LIGHT_POS, RGB(1, 1, 1))});
+    return lights;
+}
+
+// seed for the russian roulette of one path, derived from the primary ray so renders are reproducible
+uint32_t path_seed(const ray &r)
+{
+    uint64_t bits[2];
+    double x = r.get_direction().x, y = r.get_direction().y;
+    std::memcpy(&bits[0], &x, sizeof(double));
+    std::memcpy(&bits[1], &y, sizeof(double));
+    uint64_t hash = bits[0] * 0x9E3779B97F4A7C15ull ^ bits[1] * 0xC2B2AE3D27D4EB4Full;
+    uint32_t seed = static_cast<uint32_t>(hash ^ (hash >> 32));
+    return seed ? seed : 1;
+}
+
+// xorshift32, returns a number in [0, 1)
+double next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state * (1.0 / 4294967296.0);
+}
+}
+
+RGB local_shading(const Scene &scene, const BVH &bvh, const Material &mat,
+                  const ray &r, const Collision &col, const RenderSettings &settings)
+{
+    const LightSet &lights = settings.lights ? *settings.lights : default_lights();
+    vec3 pos = r.get_origin() + r.get_direction() * col.distance;
+    vec3 view_dir = (-r.get_direction()).normalize();
+    // brightest channel of the surface, a light can not change the pixel by more than this times its color
+    double reflectance = std::max({mat.color.x, mat.color.y, mat.color.z});
+
+    RGB light_sum(0, 0, 0);
+    auto add_light = [&](const Light &light) {
+        vec3 light_dir;
+        double distance = DBL_MAX;
+        double falloff = 1;
+        if (light.type == LightType::Directional)
+        {
+            light_dir = light.direction;
+        }
+        else
+        {
+            vec3 to_light = light.position - pos;
+            distance = to_light.length();
+            if (distance <= 0 || (light.range > 0 && distance >= light.range))
+                return;
+            if (light.range > 0)
+            {
+                // smooth window that reaches zero at the range
+                double ratio = distance / light.range;
+                falloff = (1 - ratio * ratio) * (1 - ratio * ratio);
+            }
+            light_dir = to_light / distance;
+        }
+        // This is a standard, physically based(tm) diffuse lighting calculation
+        double lambertian = vec3::dot(light_dir, col.normal);
+        if (lambertian <= 0)
+            return;
+        //Blinn-Phong specular
+        double specular_intensity = std::pow(std::max(vec3::dot((view_dir + light_dir).normalize(), col.normal), 0.0), mat.specular_exponent);
+        RGB contribution = light.color * (falloff * (lambertian * mat.diffuse + specular_intensity * mat.specular));
+        if (std::max({contribution.x, contribution.y, contribution.z}) * reflectance < MIN_LIGHT_CONTRIBUTION)
+            return;
+        // start minimally offset from the surface like the reflected rays
+        if (settings.shadows && bvh.occluded(scene, ray(light_dir, pos + col.normal * .0001), distance))
+            return;
+        light_sum = light_sum + contribution;
+    };
+    for (int index : lights.global_lights())
+        add_light(lights[index]);
+    for (int index : lights.local_lights(pos))
+        add_light(lights[index]);
+    return mat.color * (light_sum + RGB(mat.ambient, mat.ambient, mat.ambient));
+}
+
+PathState start_path(const ray &r, const RenderSettings &settings)
+{
+    PathState path;
+    if (settings.russian_roulette)
+        path.random_state = path_seed(r);
+    return path;
+}
+
+bool advance_path(const Scene &scene, const BVH &bvh, ray &r, const Collision &col, const RenderSettings &settings, PathState &path)
+{
+    if (col.hit_object_index < 0)
+    {
+        path.color = path.color + out_color(r.get_direction()) * path.throughput;
+        return false;
+    }
+    const Material &mat = scene.material(col.material);
+    RGB local_color = local_shading(scene, bvh, mat, r, col, settings);
+    double reflected = path.throughput * mat.metallic;
+    // the last surface of a path keeps its full weight, like the deepest level of a recursive tracer
+    if (path.bounce >= settings.max_bounces || reflected <= 0 || (!settings.russian_roulette && reflected < settings.min_throughput))
+    {
+        path.color = path.color + local_color * path.throughput;
+        return false;
+    }
+    path.color = path.color + local_color * (path.throughput - reflected);
+    path.throughput = reflected;
+    if (settings.russian_roulette && path.throughput < settings.min_throughput)
+    {
+        // continue with probability throughput / min_throughput and compensate the survivors
+        if (next_random(path.random_state) * settings.min_throughput >= path.throughput)
+            return false;
+        path.throughput = settings.min_throughput;
+    }
+
+    count(thread_counters().bounces, 1);
+    path.bounce++;
+    //start new ray minimally offset from the surface so that the new ray can not hit the surface again
+    point3 pos = r.get_origin() + r.get_direction() * col.distance;
+    r = ray(vec3::reflect(r.get_direction(), col.normal), pos + col.normal * .0001);
+    return true;
+}
+
+RGB trace_path(const Scene &scene, const BVH &bvh, ray r, Collision col,
+               const RenderSettings &settings, int &segments)
+{
+    PathState path = start_path(r, settings);
+    for (;;)
+    {
+        segments++;
+        if (!advance_path(scene, bvh, r, col, settings, path))
+            break;
+        col = find_closest_hit(scene, bvh, r);
+    }
+    return path.color;
+}
+
+RGB trace_ray(const Scene &scene, const BVH &bvh, ray r, const RenderSettings &settings, int &segments)
+{
+    return trace_path(scene, bvh, r, find_closest_hit(scene, bvh, r), settings, segments);
+}
+
+ray primary_ray(const std::vector<vec3> &u, const Camera &cam, double x, double y)
+{
+    // do not sample full image space range from 0 to 1, sample pixel centers instead
+    auto pixel_center = cam.image_top_left + u[0] * x + u[1] * y;
+    return ray(cam.position - pixel_center, cam.position);
+}
+
+/*
+* Trace the primary rays of one block of PACKET_WIDTH x PACKET_WIDTH pixels as a packet.
+* Only the first hit is found for all rays together, reflections are traced one ray at a time.
+* segments counts the traced ray segments.
+*/
+void rt_packet(std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+               Framebuffer &frame_buffer, const RenderSettings &settings, int first_row, int row_end, int row, int column, int *hit_ids,
+               int &segments)
+{
+    RayPacket packet;
+    packet.origin = cam.position;
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        int i = row + lane / PACKET_WIDTH;
+        int j = column + lane % PACKET_WIDTH;
+        // pixels outside the image still get a direction to keep the packet frustum intact
+        auto pixel_center = cam.image_top_left + u[0] * (j + settings.jitter_x) + u[1] * (i + settings.jitter_y);
+        packet.set_direction(lane, cam.position - pixel_center);
+        if (i < row_end && j < cam.image_width)
+            packet.active |= 1u << lane;
+    }
+    packet.finalize();
+
+    Collision collisions[PACKET_SIZE];
+    bvh.closest_hit(scene, packet, collisions);
+
+    for (int lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        if (!(packet.active & (1u << lane)))
+            continue;
+        ray r = packet.lane_ray(lane);
+        if (hit_ids)
+            hit_ids[(row + lane / PACKET_WIDTH - first_row) * frame_buffer.get_width() + column + lane % PACKET_WIDTH] = collisions[lane].hit_object_index;
+        frame_buffer.accumulate(row + lane / PACKET_WIDTH - first_row, column + lane % PACKET_WIDTH,
+            trace_path(scene, bvh, r, collisions[lane], settings, segments), settings.sample_weight);
+    }
+}
+
+/*
+* fill a buffer of colors with the colors seen by a camera in the scene
+*/
+RenderStats rt_scene(std::vector<vec3> u,const Scene &scene,const BVH &bvh,const Camera &cam,
+                     Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings)
+{
+    return rt_rows(u, scene, bvh, cam, frame_buffer, pool, settings, 0, cam.image_height);
+}
+
+RenderStats rt_rows(std::vector<vec3> u,const Scene &scene,const BVH &bvh,const Camera &cam,
+                    Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings, int first_row, int row_count,
+                    int *hit_ids)
+{
+    if (settings.wavefront)
+        return rt_wavefront(u, scene, bvh, cam, frame_buffer, pool, settings, first_row, row_count, hit_ids);
+    std::atomic<int64_t> segments{0};
+    int width = cam.image_width;
+    int row_end = std::min(first_row + row_count, static_cast<int>(cam.image_height));
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (row_end - first_row + TILE_SIZE - 1) / TILE_SIZE;
+
+    // every tile is one task, idle workers steal tiles from busy ones
+    pool.parallel_for(tiles_x * tiles_y, [&](int tile, int) {
+        PROFILE_SCOPE("tile");
+        int tile_x = (tile % tiles_x) * TILE_SIZE;
+        int tile_y = first_row + (tile / tiles_x) * TILE_SIZE;
+        // counted per tile, so the shared counter is only touched once per task
+        int tile_segments = 0;
+        if (settings.packets)
+        {
+            for (int i = tile_y; i < std::min(tile_y + TILE_SIZE, row_end); i += PACKET_WIDTH){
+                for(int j = tile_x; j < std::min(tile_x + TILE_SIZE, width); j += PACKET_WIDTH){
+                    rt_packet(u, scene, bvh, cam, frame_buffer, settings, first_row, row_end, i, j, hit_ids, tile_segments);
+                }
+            }
+            segments += tile_segments;
+            return;
+        }
+        for (int i = tile_y; i < std::min(tile_y + TILE_SIZE, row_end); i++){
+            for(int j = tile_x; j < std::min(tile_x + TILE_SIZE, width); j++){
+            ray cam_pixel_ray = primary_ray(u, cam, j + settings.jitter_x, i + settings.jitter_y);
+            Collision col = find_closest_hit(scene, bvh, cam_pixel_ray);
+            if (hit_ids)
+                hit_ids[(i - first_row) * frame_buffer.get_width() + j] = col.hit_object_index;
+
+            RGB color = trace_path(scene, bvh, cam_pixel_ray, col, settings, tile_segments);
+            frame_buffer.accumulate(i - first_row, j, color, settings.sample_weight);
+            }
+        }
+        segments += tile_segments;
+    });
+
+    RenderStats stats;
+    stats.paths = static_cast<int64_t>(row_end - first_row) * width;
+    stats.segments = segments;
+    return stats;
+}
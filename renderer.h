@@ -0,0 +1,120 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+#include <memory>
+#include <vector>
+
+#include "scene.h"
+#include "bvh.h"
+#include "thread_pool.h"
+#include "packet.h"
+#include "framebuffer.h"
+#include "light.h"
+
+// position of the light used when the settings do not name a light set
+#define LIGHT_POS point3(0, 0, 0)
+#define GROUND_COLOR RGB(0.025, 0.05, 0.075)
+#define SKYCOLOR_LOW RGB(0.36, 0.45, 0.57)
+#define SKYCOLOR_HIGH RGB(0.14, 0.21, 0.49)
+#define SUN_COLOR RGB(1.64, 1.27, 0.99)
+#define SUN_DIRECTION vec3(.7, .4, .7)
+// light contributions below this are skipped together with their shadow ray, half of the 8 bit display step
+#define MIN_LIGHT_CONTRIBUTION (1.0 / 512)
+
+// edge length of the square pixel blocks handed to the worker threads
+constexpr int TILE_SIZE = 16;
+static_assert(TILE_SIZE % PACKET_WIDTH == 0, "tiles have to consist of whole packets");
+
+/*
+* switches for the optional parts of the renderer
+*/
+struct RenderSettings
+{
+    // trace the primary rays of PACKET_WIDTH x PACKET_WIDTH pixel blocks together
+    bool packets = true;
+    // sub-pixel offset of the primary rays in pixels, 0 traces through the pixel centers
+    double jitter_x = 0, jitter_y = 0;
+    // weight of the new sample, 1 overwrites the frame buffer and 1 / n keeps a running mean over n samples
+    double sample_weight = 1;
+    // reflections followed after the primary hit
+    int max_bounces = 10;
+    // paths whose remaining weight falls below this are ended, the default is below 8 bit display precision
+    double min_throughput = 1.0 / 256;
+    // instead of ending them, continue paths below min_throughput at random with a matching weight
+    bool russian_roulette = false;
+    // lights of the scene, nullptr lights it with a single white point light at LIGHT_POS
+    const LightSet *lights = nullptr;
+    // test every light with a shadow ray
+    bool shadows = true;
+    // advance all paths of the image one bounce at a time over sorted ray queues, see rt_wavefront
+    bool wavefront = false;
+};
+
+/*
+* ray counts of a render
+*/
+struct RenderStats
+{
+    int64_t paths = 0;
+    // ray segments including the primary rays
+    int64_t segments = 0;
+    double average_bounces() const { return paths > 0 ? static_cast<double>(segments) / paths : 0; }
+};
+
+RGB out_color(vec3 v);
+
+Collision find_closest_hit(const Scene &scene, const BVH &bvh, ray r);
+/*
+* Color of the light a surface sends back along the ray that hit it, without reflections. Sums the
+* Blinn-Phong terms of the global lights and of the point lights whose range reaches the hit point. Lights
+* too weak to change the pixel are skipped, the others are tested for blockers with an any-hit shadow ray.
+*/
+RGB local_shading(const Scene &scene, const BVH &bvh, const Material &mat,
+                  const ray &r, const Collision &col, const RenderSettings &settings);
+// a path between two of its bounces
+struct PathState
+{
+    // light collected so far and the weight of the next surface
+    RGB color = RGB(0, 0, 0);
+    double throughput = 1;
+    // russian roulette state, seeded from the primary ray
+    uint32_t random_state = 1;
+    // reflections followed so far
+    int bounce = 0;
+};
+// state of the path of the primary ray r
+PathState start_path(const ray &r, const RenderSettings &settings);
+/*
+* One step of trace_path: adds the light the hit col sends back along r to the path. Returns whether the path
+* continues, r is then the reflected ray whose hit is not known yet.
+*/
+bool advance_path(const Scene &scene, const BVH &bvh, ray &r, const Collision &col, const RenderSettings &settings, PathState &path);
+/*
+* Color of the light transported along a ray whose first hit col is already known (a miss sees the sky).
+* Reflections are followed in a loop: every hit adds its local color weighted by the path throughput, which
+* shrinks by the metallic factor of every surface. The path ends at the sky, after settings.max_bounces
+* reflections or when the throughput falls below settings.min_throughput; the last surface then keeps its full
+* weight. segments is increased by the number of traced ray segments.
+*/
+RGB trace_path(const Scene &scene, const BVH &bvh, ray r, Collision col,
+               const RenderSettings &settings, int &segments);
+// trace_path for a ray whose first hit is not known yet
+RGB trace_ray(const Scene &scene, const BVH &bvh, ray r, const RenderSettings &settings, int &segments);
+// primary ray of the camera through the image position (x, y) in pixels, integer positions are pixel centers
+ray primary_ray(const std::vector<vec3> &u, const Camera &cam, double x, double y);
+
+/*
+* fill a buffer of colors with the colors seen by a camera in the scene. The image is split into tiles
+* of TILE_SIZE x TILE_SIZE pixels which are traced in parallel by the pool. Returns the ray counts.
+*/
+RenderStats rt_scene(std::vector<vec3> u,const Scene &scene,const BVH &bvh,const Camera &cam,
+                     Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings = RenderSettings());
+/*
+* render only the rows [first_row, first_row + row_count) of the image, row first_row ends up in row 0 of frame_buffer.
+* Used to stream large images to disk in bands. If hit_ids is given, it receives the index of the object hit by the
+* primary ray of every pixel (-1 for the sky), one row of the frame buffer width per image row.
+*/
+RenderStats rt_rows(std::vector<vec3> u,const Scene &scene,const BVH &bvh,const Camera &cam,
+                    Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings, int first_row, int row_count,
+                    int *hit_ids = nullptr);
+
+#endif
@@ -0,0 +1,77 @@
+#include "resolution.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "profiler.h"
+
+namespace
+{
+// weight of a new measurement in the smoothed cost
+constexpr double SMOOTHING = .25;
+// fraction of the target a higher scale has to stay below
+constexpr double HEADROOM = .9;
+}
+
+ResolutionController::ResolutionController(const ResolutionSettings &settings) : settings{settings}
+{
+    current.scale = settings.max_scale;
+}
+
+void ResolutionController::update(double frame_ms)
+{
+    current.frame_ms = frame_ms;
+    current.frames++;
+    current.scale_sum += current.scale;
+    double full_ms = frame_ms / (current.scale * current.scale);
+    smoothed_full_ms = smoothed_full_ms > 0 ? smoothed_full_ms + (full_ms - smoothed_full_ms) * SMOOTHING : full_ms;
+
+    auto fitting_scale = [&](double budget_ms) {
+        double scale = std::floor(std::sqrt(budget_ms / smoothed_full_ms) / SCALE_STEP) * SCALE_STEP;
+        return std::clamp(scale, settings.min_scale, settings.max_scale);
+    };
+    double scale = current.scale;
+    if (smoothed_full_ms * scale * scale > settings.target_ms)
+        scale = fitting_scale(settings.target_ms);
+    else
+        scale = std::max(scale, fitting_scale(settings.target_ms * HEADROOM));
+    if (scale != current.scale)
+    {
+        current.scale = scale;
+        current.changes++;
+    }
+}
+
+DynamicResolution::DynamicResolution(const ResolutionSettings &settings) : controller{settings}
+{
+}
+
+const ResolutionStats &DynamicResolution::render(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                                                 ThreadPool &pool, const RenderSettings &render_settings, Framebuffer &output)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    double scale = controller.scale();
+    int width = cam.image_width, height = cam.image_height;
+    int low_width = std::max(1, static_cast<int>(std::lround(width * scale)));
+    int low_height = std::max(1, static_cast<int>(std::lround(height * scale)));
+    if (low_width == width && low_height == height)
+    {
+        rt_scene(u, scene, bvh, cam, output, pool, render_settings);
+    }
+    else
+    {
+        // same image plane, fewer and larger pixels
+        Camera low_cam = cam;
+        low_cam.image_width = low_width;
+        low_cam.image_height = low_height;
+        std::vector<vec3> low_u{u[0] * (static_cast<double>(width) / low_width), u[1] * (static_cast<double>(height) / low_height)};
+        low_cam.image_top_left = cam.image_top_left + (low_u[0] + low_u[1] - u[0] - u[1]) * .5;
+        if (low.get_width() != low_width || low.get_height() != low_height)
+            low.resize(low_width, low_height);
+        rt_scene(low_u, scene, bvh, low_cam, low, pool, render_settings);
+        PROFILE_STAGE("upscale");
+        output.upscale_from(low, pool);
+    }
+    controller.update(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count());
+    return controller.stats();
+}
@@ -0,0 +1,74 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+#include <cstdint>
+#include <vector>
+
+#include "renderer.h"
+#include "framebuffer.h"
+
+/*
+* frame time budget of the dynamic resolution, the scale applies to both image axes
+*/
+struct ResolutionSettings
+{
+    // render time per frame the controller aims for
+    double target_ms = 16;
+    double min_scale = .25, max_scale = 1;
+};
+
+struct ResolutionStats
+{
+    // scale and render time of the last frame
+    double scale = 1, frame_ms = 0;
+    int64_t frames = 0;
+    // number of times the scale changed
+    int changes = 0;
+    double scale_sum = 0;
+    double mean_scale() const { return frames > 0 ? scale_sum / frames : 0; }
+};
+
+/*
+* Picks the internal render resolution from measured render times. The cost of a frame grows with its pixel
+* count, so every measurement is divided by the squared scale it was rendered at and the smoothed full
+* resolution cost gives the largest scale that fits the target. Scales are multiples of SCALE_STEP. The scale
+* drops as soon as the target is missed but only rises with some headroom, so it does not flip between two
+* steps on noisy frame times.
+*/
+class ResolutionController
+{
+    double smoothed_full_ms = 0;
+    ResolutionStats current;
+
+public:
+    static constexpr double SCALE_STEP = 1. / 32;
+    ResolutionSettings settings;
+
+    explicit ResolutionController(const ResolutionSettings &settings = ResolutionSettings());
+
+    double scale() const { return current.scale; }
+    // the frame rendered at scale() took frame_ms
+    void update(double frame_ms);
+    const ResolutionStats &stats() const { return current; }
+};
+
+/*
+* Renders the view of cam at the scale of the controller with rt_scene and upscales it bilinearly into the
+* full size output. The smaller image covers the same field of view: its pixel deltas are those of u scaled
+* by the size ratio, so the camera does not need Camera::init again after it moved. The render and upscale
+* time of every frame is fed back into the controller.
+*/
+class DynamicResolution
+{
+    Framebuffer low;
+
+public:
+    ResolutionController controller;
+
+    explicit DynamicResolution(const ResolutionSettings &settings = ResolutionSettings());
+
+    const ResolutionStats &render(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                                  ThreadPool &pool, const RenderSettings &render_settings, Framebuffer &output);
+    const ResolutionStats &stats() const { return controller.stats(); }
+};
+
+#endif
@@ -1,85 +1,362 @@
 #include "scene.h"
+#include <algorithm>
 
+void AABB::expand(const point3 &p)
+{
+    min = point3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+    max = point3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+}
 
-Collision Wall::intersect(ray r) const
+void AABB::expand(const AABB &other)
 {
-    // Calculate the denominator of the parametric equation
-    double denominator = vec3::dot(normal , r.get_direction());
+    if (other.empty())
+        return;
+    expand(other.min);
+    expand(other.max);
+}
 
-    // Calculate the parameter t for the intersection point
-    double t = vec3::dot(position - r.get_origin() , normal) / denominator;
-    
-    // Check if the intersection point is in front of the ray
-    if (t > 0) {
-        // Calculate the intersection point
-        vec3 intersection_point = r.at(t);
+double AABB::surface_area() const
+{
+    if (empty())
+        return 0;
+    vec3 extent = max - min;
+    return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
 
-        // Calculate the basis vectors for the local coordinate system of the wall
-        vec3 wallRight = (vec3::cross(normal, vec3(0, 0, 1))).normalize();
-        vec3 wallUp = (vec3::cross(wallRight , normal)).normalize();
+double AABB::intersect(const point3 &origin, const vec3 &inv_direction, double t_max) const
+{
+    // intersect the ray with the three pairs of slabs and keep the overlap of the parameter ranges
+    double tx1 = (min.x - origin.x) * inv_direction.x;
+    double tx2 = (max.x - origin.x) * inv_direction.x;
+    double t_near = std::min(tx1, tx2);
+    double t_far = std::max(tx1, tx2);
+
+    double ty1 = (min.y - origin.y) * inv_direction.y;
+    double ty2 = (max.y - origin.y) * inv_direction.y;
+    t_near = std::max(t_near, std::min(ty1, ty2));
+    t_far = std::min(t_far, std::max(ty1, ty2));
+
+    double tz1 = (min.z - origin.z) * inv_direction.z;
+    double tz2 = (max.z - origin.z) * inv_direction.z;
+    t_near = std::max(t_near, std::min(tz1, tz2));
+    t_far = std::min(t_far, std::max(tz1, tz2));
+
+    if (t_far < t_near || t_far <= 0 || t_near >= t_max)
+        return -1;
+    return t_near > 0 ? t_near : 0;
+}
 
-        // Calculate the vector from the wall position to the intersection point
-        vec3 wallToIntersection = intersection_point - position;
+namespace
+{
+/*
+* Unit vectors spanning the plane with the given unit normal. Walls have always been oriented by the cross product
+* with +z, planes facing along z fall back to +x so they get a valid basis as well.
+*/
+void plane_basis(const vec3 &normal, vec3 &right, vec3 &up)
+{
+    right = vec3::cross(normal, vec3(0, 0, 1));
+    if (right.length_squared() < 1e-12)
+        right = vec3::cross(normal, vec3(1, 0, 0));
+    right = right.normalize();
+    up = vec3::cross(right, normal).normalize();
+}
 
-        // Project the wallToIntersection vector onto the wall's local coordinate system
-        double projectionX = vec3::dot(wallToIntersection, wallRight);
-        double projectionY = vec3::dot(wallToIntersection, wallUp);
+Collision miss()
+{
+    return Collision(-1, vec3(0, 0, 0), false, -1);
+}
+}
 
-        // Check if the intersection point is within the bounds of the wall
-        if (projectionX >= 0 && projectionX <= length && projectionY >= 0 && projectionY <= width) {
-            return Collision(t, normal, true, -1);
-        }
-    }
+double PlanarRecord::intersect(const ray &r, double t_max) const
+{
+    vec3 direction = r.get_direction();
+    double denominator = vec3::dot(normal, direction);
+    if (denominator == 0)
+        return -1;
+    point3 origin_ray = r.get_origin();
+    double t = (offset - vec3::dot(normal, origin_ray)) / denominator;
+    if (t <= 0 || t >= t_max)
+        return -1;
+
+    vec3 local = origin_ray + direction * t - origin;
+    double u = vec3::dot(local, axis_u);
+    double v = vec3::dot(local, axis_v);
+    bool inside = disk ? u * u + v * v <= 1 : u >= 0 && u <= 1 && v >= 0 && v <= 1;
+    return inside ? t : -1;
+}
+
+Collision PlanarGeometry::intersect(const ray &r) const
+{
+    double t = record.intersect(r);
+    if (t < 0)
+        return miss();
+    return Collision(t, record.normal, true, -1);
+}
 
-    return Collision(-1, vec3(0, 0, 0), false , -1);
+void Wall::prepare()
+{
+    vec3 wallRight, wallUp;
+    get_basis(wallRight, wallUp);
+    record.origin = position;
+    record.normal = normal;
+    record.offset = vec3::dot(normal, position);
+    record.axis_u = wallRight / length;
+    record.axis_v = wallUp / width;
+}
+
+void Wall::get_basis(vec3 &wallRight, vec3 &wallUp) const
+{
+    plane_basis(normal, wallRight, wallUp);
+}
+
+AABB Wall::bounds() const
+{
+    vec3 wallRight, wallUp;
+    get_basis(wallRight, wallUp);
+    AABB box;
+    box.expand(position);
+    box.expand(position + wallRight * length);
+    box.expand(position + wallUp * width);
+    box.expand(position + wallRight * length + wallUp * width);
+    return box;
+}
+
+void Quad::prepare()
+{
+    // the dual vectors of the edges, dot(axis_u, edge_u) = 1 and dot(axis_u, edge_v) = 0 and the other way around
+    vec3 n = vec3::cross(edge_u, edge_v);
+    double inv_area_squared = 1. / n.length_squared();
+    record.origin = corner;
+    record.normal = n.normalize();
+    record.offset = vec3::dot(record.normal, corner);
+    record.axis_u = vec3::cross(edge_v, n) * inv_area_squared;
+    record.axis_v = vec3::cross(n, edge_u) * inv_area_squared;
+}
+
+AABB Quad::bounds() const
+{
+    AABB box;
+    box.expand(corner);
+    box.expand(corner + edge_u);
+    box.expand(corner + edge_v);
+    box.expand(corner + edge_u + edge_v);
+    return box;
+}
+
+void Disk::prepare()
+{
+    vec3 right, up;
+    plane_basis(normal, right, up);
+    record.origin = center;
+    record.normal = normal;
+    record.offset = vec3::dot(normal, center);
+    record.axis_u = right / radius;
+    record.axis_v = up / radius;
+    record.disk = true;
+}
+
+AABB Disk::bounds() const
+{
+    // the extent of a circle along an axis shrinks with the part of the normal along that axis
+    vec3 extent(radius * std::sqrt(std::max(0., 1 - normal.x * normal.x)),
+                radius * std::sqrt(std::max(0., 1 - normal.y * normal.y)),
+                radius * std::sqrt(std::max(0., 1 - normal.z * normal.z)));
+    return AABB(center - extent, center + extent);
+}
+
+AABB Sphere::bounds() const
+{
+    vec3 extent(radius, radius, radius);
+    return AABB(center - extent, center + extent);
 }
 
 /*
 * ray Sphere intersection implementation
 */
-Collision Sphere::intersect(ray r) const
+Collision Sphere::intersect(const ray &r) const
 {
-    auto ray_direction = r.get_direction();
-    
-    auto ray_origin = r.get_origin();
-    vec3 ray_sphere_vec = ray_origin - center ;
+    vec3 ray_direction = r.get_direction();
+    vec3 ray_sphere_vec = r.get_origin() - center;
 
+    // quadratic with b = 2 * half_b, which cancels the factors of 2 and 4 in the solution
     double a = ray_direction.length_squared();
+    double half_b = vec3::dot(ray_direction , ray_sphere_vec);
+    double c = ray_sphere_vec.length_squared() - radius_squared;
+    double det = half_b * half_b - a * c;
 
-    double b = 2 * vec3::dot(ray_direction , ray_sphere_vec);
+    // ray doesn't collide with the sphere
+    if(det < 0) {
+        return miss();
+    }
+    // only the nearer of the two intersection points is visible, so only that root is computed
+    double projection = (-half_b - sqrt(det)) / a;
+    vec3 intersection_point = r.at(projection);
 
-    double c = ray_sphere_vec.length_squared() - radius * radius;
+    // report the ray parameter like the planar primitives do, so distances of different objects are comparable
+    return Collision(projection, (intersection_point - center) * inv_radius, true , -1);
+}
 
-    double det = b * b - 4 * a * c;
-    // std::cout<<det<<std::endl;
+Scene::Scene() : materials{DEFAULT_MAT} {}
 
-    double projection = -1; 
-    // ray doesn't collide with the sphere
-    if(det < 0) {
-        return Collision(-1, vec3(0,0,0), false , -1);
+Scene::~Scene()
+{
+    destroy();
+}
+
+void Scene::destroy()
+{
+    for (SceneGeometry *object : arena_objects)
+        object->~SceneGeometry();
+    arena_objects.clear();
+    heap_objects.clear();
+    objects.clear();
+    flags.clear();
+    dirty_objects.clear();
+}
+
+Scene::Scene(Scene &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+Scene &Scene::operator=(Scene &&other) noexcept
+{
+    if (this != &other)
+    {
+        // the objects of this scene have to be destroyed before their arena is replaced
+        destroy();
+        arena = std::move(other.arena);
+        objects.swap(other.objects);
+        arena_objects.swap(other.arena_objects);
+        heap_objects.swap(other.heap_objects);
+        materials.swap(other.materials);
+        flags.swap(other.flags);
+        dirty_objects.swap(other.dirty_objects);
+        other.materials.assign(1, DEFAULT_MAT);
+        material_changes++;
+        other.material_changes++;
+        // a hierarchy built for either scene has to notice the change
+        revision = std::max(revision, other.revision) + 1;
+        other.revision = revision + 1;
     }
-    // ray touches the sphere with only one intersection point
-    vec3 intersection_point(0,0,0);
-    if(det == 0){
-        intersection_point = r.get_origin() + r.get_direction() * (-b / (2 * a));
-        projection = (-b - sqrt(det))/ a;
+    return *this;
+}
+
+SceneGeometry *Scene::add(std::unique_ptr<SceneGeometry> object)
+{
+    objects.push_back(object.get());
+    heap_objects.push_back(std::move(object));
+    flags.push_back(0);
+    revision++;
+    return objects.back();
+}
+
+std::unique_ptr<SceneGeometry> Scene::release(size_t index)
+{
+    for (auto &object : heap_objects)
+    {
+        if (object && object.get() == objects[index])
+        {
+            objects[index] = nullptr;
+            revision++;
+            return std::move(object);
+        }
     }
-    // ray touches the sphere with 2 intersection points
-    else{
-        // std:: cout << b << std::endl;
-        double p1 = (-b + sqrt(det)) / (2 * a);
-        double p2 = (-b - sqrt(det)) / (2 * a);
-        projection = p1 < p2 ? p1 : p2;
-        // std::cout << a << std::endl;
-
-        intersection_point = ray_origin + ray_direction * projection;
+    return nullptr;
+}
+
+void Scene::append(Scene &&other)
+{
+    uint32_t offset = materials.size() - 1;
+    materials.insert(materials.end(), other.materials.begin() + 1, other.materials.end());
+    material_changes++;
+    for (SceneGeometry *object : other.objects)
+    {
+        if (object && object->material_index() != DEFAULT_MATERIAL)
+            object->set_material_index(object->material_index() + offset);
+    }
+    arena.append(std::move(other.arena));
+    objects.insert(objects.end(), other.objects.begin(), other.objects.end());
+    arena_objects.insert(arena_objects.end(), other.arena_objects.begin(), other.arena_objects.end());
+    for (auto &object : other.heap_objects)
+        heap_objects.push_back(std::move(object));
+    size_t first = flags.size();
+    flags.insert(flags.end(), other.flags.begin(), other.flags.end());
+    for (int index : other.dirty_objects)
+        dirty_objects.push_back(index + first);
+    revision++;
+    // the objects belong to this scene now, other must not destroy them
+    other.objects.clear();
+    other.arena_objects.clear();
+    other.heap_objects.clear();
+    other.materials.assign(1, DEFAULT_MAT);
+    other.material_changes++;
+    other.flags.clear();
+    other.dirty_objects.clear();
+    other.revision++;
+}
+
+uint32_t Scene::add_material(const Material &material)
+{
+    materials.push_back(material);
+    material_changes++;
+    return materials.size() - 1;
+}
+
+void Scene::set_material(uint32_t index, const Material &material)
+{
+    materials[index] = material;
+    material_changes++;
+}
+
+void Scene::set_dynamic(size_t index, bool dynamic)
+{
+    if (is_dynamic(index) == dynamic)
+        return;
+    flags[index] ^= DYNAMIC;
+    revision++;
+}
+
+void Scene::mark_dirty(size_t index)
+{
+    moves++;
+    if (flags[index] & DIRTY)
+        return;
+    flags[index] |= DIRTY;
+    dirty_objects.push_back(index);
+}
+
+void Scene::clear_dirty()
+{
+    for (int index : dirty_objects)
+        flags[index] &= ~DIRTY;
+    dirty_objects.clear();
+}
+
+SceneMemory Scene::memory() const
+{
+    SceneMemory memory;
+    memory.objects = objects.size();
+    memory.arena_used = arena.used_bytes();
+    memory.arena_reserved = arena.reserved_bytes();
+    memory.heap_objects = heap_objects.size();
+    for (SceneGeometry *object : objects)
+    {
+        if (object)
+            memory.object_buffers += object->memory_size();
     }
-    return Collision(projection * ray_direction.length(), intersection_point - center, true , -1);
+    memory.materials = materials.size();
+    memory.material_bytes = materials.capacity() * sizeof(Material);
+    memory.index_bytes = (objects.capacity() + arena_objects.capacity()) * sizeof(SceneGeometry *) +
+                         heap_objects.capacity() * sizeof(std::unique_ptr<SceneGeometry>) + flags.capacity() +
+                         dirty_objects.capacity() * sizeof(int);
+    return memory;
 }
 
 std::vector<vec3> Camera::init(){
     vec3   u, v, w;        // Camera frame basis vectors
-    image_height = static_cast<int>(image_width / aspect_ratio);
+    // a requested height is kept exactly, rebuilding it from the aspect ratio can round it down
+    image_height = requested_height > 0 ? requested_height : static_cast<int>(image_width / aspect_ratio);
     focal_length = (position - lookat).length();
     auto theta = vfov * 3.14 / 180.0;
     auto h = tan(theta/2);
@@ -119,23 +396,28 @@ vec3 Camera::up_vec()
 }
 
 void Camera::forward(){
+    revision++;
     position = position + forward_vec() * movement_speed;
 }
 
 void Camera::backward(){
+    revision++;
     position = position - forward_vec() * movement_speed;
 }
 
 void Camera::right(){
+    revision++;
     position = position + right_vec() * movement_speed;
 }
 
 void Camera::left(){
+    revision++;
     position = position - right_vec() * movement_speed;
 }
 
 void Camera::rotate_left_right(double angle)
 {
+    revision++;
     double current_angle = std::atan2(direction.y, direction.x);
     double new_angle = current_angle + angle;
 
@@ -146,6 +428,7 @@ void Camera::rotate_left_right(double angle)
 
 void Camera::rotate_up_down(double angle)
 {
+    revision++;
 
     double base_length = vec3(direction.x, direction.y,0).length();
     double pitch_angle = std::atan2(direction.z, base_length);
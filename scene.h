@@ -1,6 +1,14 @@
+#ifndef SCENE_H
+#define SCENE_H
 #include "vec.h"
+#include "arena.h"
+#include <cstdint>
+#include <memory>
 #include <vector>
+#include <float.h>
 #define DEFAULT_MAT Material(RGB(1, 1, 1), .9, .9, .3, 30)
+// material pool index of DEFAULT_MAT, every scene starts with it
+#define DEFAULT_MATERIAL 0u
 
 class ray
 {
@@ -16,23 +24,48 @@ class ray
     point3 at (double t) const {
         return origin + direction * t;
     }
-    vec3 get_direction(){
+    vec3 get_direction() const {
         return direction;
     }
-    vec3 get_origin(){
+    vec3 get_origin() const {
         return origin;
     }
 };
 
+/*
+* axis aligned bounding box, used by the acceleration structure to skip whole groups of scene objects
+*/
+struct AABB
+{
+    point3 min = point3(DBL_MAX, DBL_MAX, DBL_MAX);
+    point3 max = point3(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+
+    AABB() {}
+    AABB(point3 min, point3 max) : min{min}, max{max} {}
+
+    void expand(const point3 &p);
+    void expand(const AABB &other);
+    bool empty() const { return min.x > max.x; }
+    point3 centroid() const { return (min + max) * .5; }
+    double surface_area() const;
+    // slab test, returns the entry distance or -1 if the box is missed or farther away than t_max
+    double intersect(const point3 &origin, const vec3 &inv_direction, double t_max) const;
+};
+
 struct Collision{
     double distance;
     vec3 normal;
     bool hit;
     int hit_object_index;
+    // material pool index of the hit object, filled in by the scene queries
+    uint32_t material = DEFAULT_MATERIAL;
+    // placeholder collision with highest possible distance and no intersection
+    Collision() : Collision(DBL_MAX, vec3(0, 0, 0), false, -1) {}
     Collision(double distance, vec3 normal, bool hit , int hit_object_index) : distance{distance}, normal{normal}, hit{hit}, hit_object_index{hit_object_index}{}
 };
 
-struct Material
+// one material per cache line, 64 bytes with double precision colors
+struct alignas(CACHE_LINE_SIZE) Material
 {
     RGB color;
     // how much the object is lit without a light
@@ -50,37 +83,251 @@ struct Material
 
 class SceneGeometry
 {
-    Material mat;
+    // index into the material pool of the scene
+    uint32_t material;
 
 public:
-    SceneGeometry(Material mat) : mat(mat){}
-    virtual Collision intersect(ray r) const = 0;
+    SceneGeometry(uint32_t material = DEFAULT_MATERIAL) : material(material){}
+    virtual Collision intersect(const ray &r) const = 0;
+    // world space bounds of the object, an empty box if the object can never be hit
+    virtual AABB bounds() const = 0;
     virtual ~SceneGeometry() {}
-    Material get_material() { return mat; }
+    // bytes the object owns outside of its own storage, like the buffers of a mesh
+    virtual size_t memory_size() const { return 0; }
+    uint32_t material_index() const { return material; }
+    void set_material_index(uint32_t index) { material = index; }
+};
+
+/*
+* Intersection data of a flat primitive, prepared once when the primitive is built or changed, so a ray test is
+* one division and three dot products. The local coordinates of a point p on the plane are dot(p - origin, axis_u)
+* and dot(p - origin, axis_v). The axes are scaled by the inverse extents of the primitive, so rectangles cover
+* [0, 1] x [0, 1] and disks the unit circle whatever their size.
+*/
+struct PlanarRecord
+{
+    point3 origin;
+    vec3 normal;
+    vec3 axis_u, axis_v;
+    // dot(normal, origin)
+    double offset = 0;
+    bool disk = false;
+
+    // ray parameter of the hit in (0, t_max), -1 on a miss. Rays parallel to the plane never hit it
+    double intersect(const ray &r, double t_max = DBL_MAX) const;
+};
+
+/*
+* Base of the flat primitives, which all share the intersection through their PlanarRecord. Subclasses fill
+* the record in their constructors and setters.
+*/
+class PlanarGeometry : public SceneGeometry
+{
+protected:
+    PlanarRecord record;
+
+public:
+    using SceneGeometry::SceneGeometry;
+    Collision intersect(const ray &r) const override;
+    const PlanarRecord &get_record() const { return record; }
 };
 
-class Wall : public SceneGeometry
+class Wall : public PlanarGeometry
 {
     point3 position;  // Center or starting point of the wall
     vec3 normal;      // Normal vector representing the orientation of the wall
     double length;     // Length of the wall
     double width;      // Width of the wall (optional)
 
+    void prepare();
+
+public:
+    Wall(uint32_t material = DEFAULT_MATERIAL, point3 position = point3(0,0,0), vec3 normal = vec3(0,0,0), double length= 1.0, double width = 1.0)
+        : PlanarGeometry{material}, position{position}, normal{normal.normalize()}, length{length}, width{width} { prepare(); }
+    AABB bounds() const override;
+
+    point3 get_position() const { return position; }
+    vec3 get_normal() const { return normal; }
+    double get_length() const { return length; }
+    double get_width() const { return width; }
+    // unit vectors along the length and the width of the wall
+    void get_basis(vec3 &wallRight, vec3 &wallUp) const;
+    // moving a wall in a scene needs Scene::mark_dirty
+    void set_position(point3 new_position) { position = new_position; prepare(); }
+};
+
+/*
+* Parallelogram spanned by two edges from a corner, the normal follows the right hand rule from edge_u to edge_v
+*/
+class Quad : public PlanarGeometry
+{
+    point3 corner;
+    vec3 edge_u, edge_v;
+
+    void prepare();
+
+public:
+    Quad(uint32_t material, point3 corner, vec3 edge_u, vec3 edge_v)
+        : PlanarGeometry{material}, corner{corner}, edge_u{edge_u}, edge_v{edge_v} { prepare(); }
+    AABB bounds() const override;
+
+    point3 get_corner() const { return corner; }
+    vec3 get_edge_u() const { return edge_u; }
+    vec3 get_edge_v() const { return edge_v; }
+    // moving a quad in a scene needs Scene::mark_dirty
+    void set_corner(point3 new_corner) { corner = new_corner; prepare(); }
+};
+
+class Disk : public PlanarGeometry
+{
+    point3 center;
+    vec3 normal;
+    double radius;
+
+    void prepare();
+
 public:
-    Wall(Material mat = DEFAULT_MAT, point3 position = point3(0,0,0), vec3 normal = vec3(0,0,0), double length= 1.0, double width = 1.0)
-        : SceneGeometry{mat}, position{position}, normal{normal.normalize()}, length{length}, width{width} {}
-    Collision intersect(ray r) const override;
+    Disk(uint32_t material, point3 center, vec3 normal, double radius)
+        : PlanarGeometry{material}, center{center}, normal{normal.normalize()}, radius{radius} { prepare(); }
+    AABB bounds() const override;
+
+    point3 get_center() const { return center; }
+    vec3 get_normal() const { return normal; }
+    double get_radius() const { return radius; }
+    // changing a disk in a scene needs Scene::mark_dirty
+    void set_center(point3 new_center) { center = new_center; prepare(); }
+    void set_radius(double new_radius) { radius = new_radius; prepare(); }
 };
 
 class Sphere : public SceneGeometry
 {
     point3 center;
     double radius;
+    // prepared from the radius, so a ray test needs neither a multiplication for c nor a division for the normal
+    double radius_squared, inv_radius;
+
+    void prepare() { radius_squared = radius * radius; inv_radius = 1. / radius; }
+
+public:
+    Sphere(uint32_t material = DEFAULT_MATERIAL, point3 center = point3(0,0,0), double radius = 1.0) 
+    : SceneGeometry{material}, center{center}, radius{radius} { prepare(); }
+    Collision intersect(const ray &r) const override;
+    AABB bounds() const override;
+
+    point3 get_center() const { return center; }
+    double get_radius() const { return radius; }
+    double get_radius_squared() const { return radius_squared; }
+    // changing a sphere in a scene needs Scene::mark_dirty
+    void set_center(point3 new_center) { center = new_center; }
+    void set_radius(double new_radius) { radius = new_radius; prepare(); }
+};
+
+// memory taken by a scene, see Scene::memory
+struct SceneMemory
+{
+    size_t objects = 0;
+    // bytes of the arena holding objects and the bytes of its chunks
+    size_t arena_used = 0, arena_reserved = 0;
+    // objects allocated on their own, like loaded meshes
+    size_t heap_objects = 0;
+    // buffers owned by the objects, see SceneGeometry::memory_size
+    size_t object_buffers = 0;
+    size_t materials = 0, material_bytes = 0;
+    // the object pointer table
+    size_t index_bytes = 0;
+
+    size_t total() const { return arena_reserved + object_buffers + material_bytes + index_bytes; }
+};
+
+/*
+* Objects and materials of a scene. Objects are constructed in an arena, so a scene of small primitives is a few
+* contiguous cache line aligned chunks instead of one heap block per object. Materials live in their own contiguous
+* pool and are referenced by 32 bit indices, index DEFAULT_MATERIAL holds DEFAULT_MAT. Indices stay valid for the
+* life of the scene. Objects that are built elsewhere, like meshes from the loaders, can be handed over as
+* unique_ptr. Reads like the vector of objects it replaces: scene[i]->intersect(r).
+*/
+class Scene
+{
+    Arena arena;
+    std::vector<SceneGeometry *> objects;
+    // objects constructed in the arena, destroyed with the scene
+    std::vector<SceneGeometry *> arena_objects;
+    std::vector<std::unique_ptr<SceneGeometry>> heap_objects;
+    std::vector<Material> materials;
+    // DYNAMIC and DIRTY bits per object
+    std::vector<uint8_t> flags;
+    std::vector<int> dirty_objects;
+    unsigned revision = 0;
+    // counts mark_dirty and material changes, they never go back so revisions built from them never repeat
+    unsigned moves = 0, material_changes = 0;
+
+    static constexpr uint8_t DYNAMIC = 1, DIRTY = 2;
+
+    void destroy();
 
 public:
-    Sphere(Material mat = DEFAULT_MAT, point3 center = point3(0,0,0), double radius = 1.0) 
-    : SceneGeometry{mat}, center{center}, radius{radius}{}
-    Collision intersect(ray r) const override;
+    Scene();
+    ~Scene();
+    Scene(Scene &&other) noexcept;
+    Scene &operator=(Scene &&other) noexcept;
+    Scene(const Scene &) = delete;
+    Scene &operator=(const Scene &) = delete;
+
+    // construct an object in the arena, the object index is size() - 1 afterwards
+    template <class T, class... Args>
+    T *add(Args &&...args)
+    {
+        T *object = arena.template create<T>(std::forward<Args>(args)...);
+        objects.push_back(object);
+        arena_objects.push_back(object);
+        flags.push_back(0);
+        revision++;
+        return object;
+    }
+    // take over an object allocated elsewhere
+    SceneGeometry *add(std::unique_ptr<SceneGeometry> object);
+    /*
+    * Give up an object that was added as unique_ptr, nullptr for arena objects. The slot stays in the scene as
+    * nullptr, meant for moving objects into a replacement scene.
+    */
+    std::unique_ptr<SceneGeometry> release(size_t index);
+    /*
+    * Move all objects and materials of other to the end of this scene. The material indices of the moved objects
+    * are shifted to their new place in the pool, DEFAULT_MATERIAL stays DEFAULT_MATERIAL.
+    */
+    void append(Scene &&other);
+
+    uint32_t add_material(const Material &material);
+    // change a material in place, the objects using it keep their index
+    void set_material(uint32_t index, const Material &material);
+    const Material &material(uint32_t index) const { return materials[index]; }
+    size_t material_count() const { return materials.size(); }
+
+    size_t size() const { return objects.size(); }
+    bool empty() const { return objects.empty(); }
+    SceneGeometry *operator[](size_t index) const { return objects[index]; }
+    std::vector<SceneGeometry *>::const_iterator begin() const { return objects.begin(); }
+    std::vector<SceneGeometry *>::const_iterator end() const { return objects.end(); }
+
+    /*
+    * Dynamic objects are kept in a hierarchy of their own, so moving them every frame costs time in proportion to
+    * their number and not to the size of the scene. Takes effect with the next BVH::build.
+    */
+    void set_dynamic(size_t index, bool dynamic = true);
+    bool is_dynamic(size_t index) const { return flags[index] & DYNAMIC; }
+    // record that an object moved or changed its shape, BVH::update refits the hierarchy around it
+    void mark_dirty(size_t index);
+    // objects marked dirty since the last clear_dirty, in marking order without duplicates
+    const std::vector<int> &dirty() const { return dirty_objects; }
+    void clear_dirty();
+    // changes whenever objects are added or removed or change between static and dynamic
+    unsigned structure_revision() const { return revision; }
+    // changes with the structure and whenever an object is marked dirty, the primary hits of a view stay valid until then
+    unsigned geometry_revision() const { return revision + moves; }
+    // changes whenever a material is added or changed
+    unsigned material_revision() const { return material_changes; }
+
+    SceneMemory memory() const;
 };
 
 class Camera
@@ -93,10 +340,14 @@ private:
 public:
     vec3 direction, fov_top_left, image_top_left, pixel_delta_x , pixel_delta_y;
     double movement_speed, aspect_ratio , image_width, image_height, focal_length , vfov;
+    // image height set by init, 0 derives it from image_width and aspect_ratio
+    int requested_height = 0;
 
     point3 position = point3(0,0,-1);  // Point camera is looking from
     point3 lookat   = point3(0,0,0);   // Point camera is looking at
     vec3   vup      = vec3(0,1,0);     // Camera-relative "up" direction
+    // incremented by the movement functions, so renderers can tell whether the view changed
+    unsigned revision = 0;
 
     Camera (){}
     std::vector<vec3> init ();
@@ -109,4 +360,6 @@ public:
 
     void rotate_left_right(double angle);
     void rotate_up_down(double angle);
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,294 @@
+#include "scene_file.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+#include "mesh_io.h"
+#include "renderer.h"
+
+namespace
+{
+// size of the read buffer of scene files
+constexpr size_t READ_BUFFER_SIZE = 1 << 20;
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull, FNV_PRIME = 1099511628211ull;
+
+// FNV-1a over the bytes of text, continuing from hash
+uint64_t hash_text(uint64_t hash, std::string_view text)
+{
+    for (char c : text)
+        hash = (hash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+    return hash;
+}
+
+/*
+* Cursor over one line of the scene file. The line is zero terminated, so numbers are read in place with strtod.
+*/
+class LineReader
+{
+    const char *p;
+
+    void skip_spaces()
+    {
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+    }
+
+public:
+    LineReader(const char *line) : p{line} { skip_spaces(); }
+
+    // true if only spaces or a comment are left
+    bool at_end() const { return *p == '\0' || *p == '#'; }
+
+    std::string_view word()
+    {
+        const char *start = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#')
+            p++;
+        std::string_view result(start, p - start);
+        skip_spaces();
+        return result;
+    }
+
+    bool number(double &value)
+    {
+        char *end;
+        value = std::strtod(p, &end);
+        if (end == p)
+            return false;
+        p = end;
+        skip_spaces();
+        return true;
+    }
+
+    bool vector(vec3 &value) { return number(value.x) && number(value.y) && number(value.z); }
+};
+}
+
+bool parse_scene(std::istream &input, const std::string &name, const std::string &base_directory,
+                 Scene &scene, Camera &cam, std::vector<Light> &lights,
+                 SceneLoadStats *stats)
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+    // the objects are collected in a scene of their own so a broken file leaves the scene as it was
+    Scene objects;
+    std::unordered_map<std::string, uint32_t> materials = {{"default", DEFAULT_MATERIAL}};
+    Camera parsed_cam = cam;
+    std::vector<Light> parsed_lights;
+    // the last material lookup, consecutive objects usually share their material
+    std::string last_material_name;
+    uint32_t last_material = DEFAULT_MATERIAL;
+    bool last_material_valid = false;
+    uint64_t geometry_hash = FNV_OFFSET;
+
+    std::string line;
+    size_t line_number = 0;
+    auto fail = [&](const std::string &message) {
+        std::cerr << name << ":" << line_number << ": " << message << std::endl;
+        return false;
+    };
+    while (std::getline(input, line))
+    {
+        line_number++;
+        LineReader reader(line.c_str());
+        if (reader.at_end())
+            continue;
+        std::string_view keyword = reader.word();
+
+        if (keyword == "sphere" || keyword == "wall" || keyword == "quad" || keyword == "disk" || keyword == "mesh")
+        {
+            std::string_view material_name = reader.word();
+            // the record without its material, line is zero terminated so the rest of it is a valid view
+            geometry_hash = hash_text(hash_text(geometry_hash, keyword), material_name.data() + material_name.size());
+            if (!last_material_valid || material_name != last_material_name)
+            {
+                auto found = materials.find(std::string(material_name));
+                if (found == materials.end())
+                    return fail("unknown material " + std::string(material_name));
+                last_material_name = material_name;
+                last_material = found->second;
+                last_material_valid = true;
+            }
+
+            if (keyword == "sphere")
+            {
+                point3 center;
+                double radius;
+                if (!reader.vector(center) || !reader.number(radius))
+                    return fail("expected sphere <material> <x y z> <radius>");
+                objects.add<Sphere>(last_material, center, radius);
+            }
+            else if (keyword == "wall")
+            {
+                point3 corner;
+                vec3 normal;
+                double length, width;
+                if (!reader.vector(corner) || !reader.vector(normal) || !reader.number(length) || !reader.number(width))
+                    return fail("expected wall <material> <x y z> <nx ny nz> <length> <width>");
+                if (normal.length_squared() == 0)
+                    return fail("wall normal is zero");
+                objects.add<Wall>(last_material, corner, normal, length, width);
+            }
+            else if (keyword == "quad")
+            {
+                point3 corner;
+                vec3 edge_u, edge_v;
+                if (!reader.vector(corner) || !reader.vector(edge_u) || !reader.vector(edge_v))
+                    return fail("expected quad <material> <x y z> <ux uy uz> <vx vy vz>");
+                if (vec3::cross(edge_u, edge_v).length_squared() == 0)
+                    return fail("quad edges are parallel");
+                objects.add<Quad>(last_material, corner, edge_u, edge_v);
+            }
+            else if (keyword == "disk")
+            {
+                point3 center;
+                vec3 normal;
+                double radius;
+                if (!reader.vector(center) || !reader.vector(normal) || !reader.number(radius))
+                    return fail("expected disk <material> <x y z> <nx ny nz> <radius>");
+                if (normal.length_squared() == 0)
+                    return fail("disk normal is zero");
+                objects.add<Disk>(last_material, center, normal, radius);
+            }
+            else
+            {
+                std::string_view file = reader.word();
+                if (file.empty())
+                    return fail("expected mesh <material> <file.obj>");
+                std::filesystem::path mesh_path(file);
+                if (mesh_path.is_relative())
+                    mesh_path = std::filesystem::path(base_directory) / mesh_path;
+                std::error_code time_error;
+                auto write_time = std::filesystem::last_write_time(mesh_path, time_error).time_since_epoch().count();
+                geometry_hash = hash_text(geometry_hash, std::to_string(write_time));
+                auto mesh = load_mesh(mesh_path.string(), last_material);
+                if (!mesh)
+                    return fail("could not load mesh " + mesh_path.string());
+                objects.add(std::move(mesh));
+            }
+        }
+        else if (keyword == "material")
+        {
+            std::string material_name(reader.word());
+            RGB color;
+            if (material_name.empty() || !reader.vector(color))
+                return fail("expected material <name> <r g b> [metallic|ambient|diffuse|specular|exponent value]...");
+            Material mat(color);
+            while (!reader.at_end())
+            {
+                std::string_view parameter = reader.word();
+                double value;
+                if (!reader.number(value))
+                    return fail("missing value of " + std::string(parameter));
+                if (parameter == "metallic")
+                    mat.metallic = value;
+                else if (parameter == "ambient")
+                    mat.ambient = value;
+                else if (parameter == "diffuse")
+                    mat.diffuse = value;
+                else if (parameter == "specular")
+                    mat.specular = value;
+                else if (parameter == "exponent")
+                    mat.specular_exponent = value;
+                else
+                    return fail("unknown material parameter " + std::string(parameter));
+            }
+            // redefining a name only affects the objects after it
+            materials.insert_or_assign(material_name, objects.add_material(mat));
+            last_material_valid = false;
+        }
+        else if (keyword == "light")
+        {
+            std::string_view type = reader.word();
+            if (type == "point")
+            {
+                point3 position;
+                RGB color;
+                if (!reader.vector(position) || !reader.vector(color))
+                    return fail("expected light point <x y z> <r g b> [range R]");
+                double range = 0;
+                if (!reader.at_end())
+                {
+                    if (reader.word() != "range" || !reader.number(range) || range < 0)
+                        return fail("expected range <distance> after the point light color");
+                }
+                parsed_lights.push_back(Light::point(position, color, range));
+            }
+            else if (type == "sun")
+            {
+                vec3 direction = SUN_DIRECTION;
+                RGB color = SUN_COLOR;
+                if (!reader.at_end() && (!reader.vector(direction) || !reader.vector(color)))
+                    return fail("expected light sun [<dx dy dz> <r g b>]");
+                if (direction.length_squared() == 0)
+                    return fail("sun direction is zero");
+                parsed_lights.push_back(Light::sun(direction, color));
+            }
+            else
+            {
+                return fail("unknown light type " + std::string(type));
+            }
+        }
+        else if (keyword == "camera")
+        {
+            while (!reader.at_end())
+            {
+                std::string_view parameter = reader.word();
+                bool valid;
+                if (parameter == "position")
+                    valid = reader.vector(parsed_cam.position);
+                else if (parameter == "lookat")
+                    valid = reader.vector(parsed_cam.lookat);
+                else if (parameter == "up")
+                    valid = reader.vector(parsed_cam.vup);
+                else if (parameter == "fov")
+                    valid = reader.number(parsed_cam.vfov);
+                else
+                    return fail("unknown camera parameter " + std::string(parameter));
+                if (!valid)
+                    return fail("missing value of " + std::string(parameter));
+            }
+        }
+        else
+        {
+            return fail("unknown record " + std::string(keyword));
+        }
+        if (!reader.at_end())
+            return fail("unexpected " + std::string(reader.word()));
+    }
+    if (input.bad())
+        return fail("read error");
+
+    if (stats)
+    {
+        stats->parse_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+        stats->lines = line_number;
+        stats->objects = objects.size();
+        stats->materials = objects.material_count() - 1;
+        stats->lights = parsed_lights.size();
+        stats->geometry_hash = geometry_hash;
+    }
+    scene.append(std::move(objects));
+    cam = parsed_cam;
+    lights.insert(lights.end(), parsed_lights.begin(), parsed_lights.end());
+    return true;
+}
+
+bool load_scene(const std::string &path, Scene &scene, Camera &cam,
+                std::vector<Light> &lights, SceneLoadStats *stats)
+{
+    // a large buffer keeps the number of reads low for scenes with millions of lines
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    std::ifstream file;
+    file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+    return parse_scene(file, path, std::filesystem::path(path).parent_path().string(), scene, cam, lights, stats);
+}
@@ -0,0 +1,61 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+#include "light.h"
+
+/*
+* Scene description format, one record per line, # starts a comment:
+*
+*   camera position 0 0 0 lookat -1 0 0 up 0 0 -1 fov 90
+*   material green 0 1 0 metallic 0.5 ambient 0.1 diffuse 0.9 specular 0.4 exponent 50
+*   sphere green  1.5 0 0  0.5
+*   wall blue  3 2 0  0 -1 0  1 1
+*   quad blue  3 2 0  0 0 1  1 0 0
+*   disk blue  3 2 0  0 -1 0  0.5
+*   mesh grey model.obj
+*   light point 0 0 0  1 1 1  range 10
+*   light sun .7 .4 .7  1.64 1.27 0.99
+*
+* The camera keywords are optional and keep their current value when left out, so are the material
+* parameters after the color. Objects name a material defined before them, "default" is DEFAULT_MAT.
+* Walls take corner, normal, length and width, quads a corner and two edges, disks center, normal and radius.
+* Meshes are loaded through load_mesh relative to the scene file.
+* Point lights take position and color and optionally the distance at which they fade out, suns take the
+* direction towards them and their color, a bare "light sun" uses SUN_DIRECTION and SUN_COLOR.
+*/
+
+// how long reading a scene took and what it contained
+struct SceneLoadStats
+{
+    double parse_ms = 0;
+    size_t lines = 0;
+    size_t objects = 0;
+    size_t materials = 0;
+    size_t lights = 0;
+    /*
+    * Hash of the object records without their material names, equal for two files that only differ in materials,
+    * lights, the camera or comments. Meshes are identified by their path and modification time.
+    */
+    uint64_t geometry_hash = 0;
+};
+
+/*
+* Parse a scene description line by line and append its objects to scene and its lights to lights. The camera
+* records update cam, call cam.init() afterwards. name is used in error messages and mesh paths are relative to
+* base_directory. Prints the first error with its line number and returns false, the outputs are left untouched
+* in that case.
+*/
+bool parse_scene(std::istream &input, const std::string &name, const std::string &base_directory,
+                 Scene &scene, Camera &cam, std::vector<Light> &lights,
+                 SceneLoadStats *stats = nullptr);
+// parse_scene on a file
+bool load_scene(const std::string &path, Scene &scene, Camera &cam,
+                std::vector<Light> &lights, SceneLoadStats *stats = nullptr);
+
+#endif
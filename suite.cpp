@@ -0,0 +1,336 @@
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+#include "scene.h"
+#include "bvh.h"
+#include "renderer.h"
+#include "thread_pool.h"
+#include "mesh.h"
+#include "scene_file.h"
+#include "profiler.h"
+
+/*
+* Headless render benchmarks of a fixed set of canonical scenes, all at 640x480 with every hardware thread:
+*
+*   ./RaytracerSuite --benchmark_out=baseline.json
+*   ./RaytracerSuite --baseline baseline.json --threshold 5
+*
+* Every scene reports the frame time, the traced rays per second including shadow rays and the memory taken by
+* the scene and its hierarchy. --benchmark_out writes the results as JSON, a file written that way can later be
+* passed as --baseline, then every benchmark that got slower by more than --threshold percent (default 5) is
+* listed and the suite exits with 1.
+*/
+
+namespace
+{
+constexpr int SUITE_WIDTH = 640;
+constexpr double DEFAULT_THRESHOLD = 5;
+
+// everything needed to render one canonical scene
+struct CanonicalScene
+{
+    Scene objects;
+    Camera cam;
+    std::vector<Light> lights;
+    RenderSettings settings;
+};
+
+CanonicalScene parse_canonical(const char *name, const char *text)
+{
+    CanonicalScene result;
+    std::istringstream input(text);
+    if (!parse_scene(input, name, ".", result.objects, result.cam, result.lights))
+        std::abort();
+    return result;
+}
+
+// the built-in scene of the viewer: a few spheres and walls, most pixels see the sky
+CanonicalScene large_primitives()
+{
+    return parse_canonical("large_primitives", R"(
+camera position 0 0 0 lookat -1 0 0 up 0 0 -1 fov 90
+material green 0 1 0 metallic 0.5
+material blue 0 0 1
+material plain_green 0 1 0
+sphere green 1.5 0 0 0.5
+wall blue 3 2 0 0 -1 0 1 1
+wall plain_green 3 -3 0 0 1 0 2 2
+light point 0 0 0 1 1 1
+)");
+}
+
+// 10k small random spheres filling the view, the hierarchy dominates
+CanonicalScene random_spheres()
+{
+    CanonicalScene result;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> position(-10, 10);
+    std::uniform_real_distribution<double> radius(.05, .3);
+    std::uniform_real_distribution<double> channel(0, 1);
+    for (int i = 0; i < 10000; i++)
+    {
+        Material mat(RGB(channel(rng), channel(rng), channel(rng)), channel(rng) < .2 ? .5 : 0);
+        result.objects.add<Sphere>(result.objects.add_material(mat), point3(position(rng), position(rng), position(rng)), radius(rng));
+    }
+    // camera rays point away from lookat, see Camera::init
+    result.cam.position = point3(0, 0, 12);
+    result.cam.lookat = point3(0, 0, 24);
+    result.cam.vup = vec3(0, 1, 0);
+    result.cam.vfov = 90;
+    result.lights.push_back(Light::sun(SUN_DIRECTION, SUN_COLOR));
+    return result;
+}
+
+// the camera inside a tall shaft of four mirrors, most paths bounce until their weight runs out
+CanonicalScene mirror_box()
+{
+    CanonicalScene result = parse_canonical("mirror_box", R"(
+camera position 0 0 0 lookat -1 0 0 up 0 0 -1 fov 90
+material mirror 0.9 0.9 0.9 metallic 0.95
+material red 1 0 0 metallic 0.5
+wall mirror 6 2 -20 0 -1 0 8 40
+wall mirror -2 -2 -20 0 1 0 8 40
+wall mirror 6 -2 -20 -1 0 0 4 40
+wall mirror -2 2 -20 1 0 0 4 40
+sphere red 3 0 0 0.75
+light point 0 0 -1.5 1 1 1
+)");
+    result.settings.max_bounces = 16;
+    return result;
+}
+
+// one finely tessellated sphere of about 130k triangles
+CanonicalScene triangle_heavy()
+{
+    const int rings = 256, segments = 256;
+    std::vector<float> positions, normals;
+    std::vector<uint32_t> triangles;
+    for (int i = 0; i <= rings; i++)
+    {
+        double theta = M_PI * i / rings;
+        for (int j = 0; j < segments; j++)
+        {
+            double phi = 2 * M_PI * j / segments;
+            float x = std::sin(theta) * std::cos(phi), y = std::sin(theta) * std::sin(phi), z = std::cos(theta);
+            positions.insert(positions.end(), {2 + x, y, z});
+            normals.insert(normals.end(), {x, y, z});
+        }
+    }
+    for (uint32_t i = 0; i < rings; i++)
+    {
+        for (uint32_t j = 0; j < segments; j++)
+        {
+            uint32_t a = i * segments + j, b = i * segments + (j + 1) % segments;
+            uint32_t c = a + segments, d = b + segments;
+            triangles.insert(triangles.end(), {a, c, d, a, d, b});
+        }
+    }
+    CanonicalScene result = parse_canonical("triangle_heavy", "camera position 0 0 0 lookat -1 0 0 up 0 0 -1 fov 60\n");
+    uint32_t grey = result.objects.add_material(Material(RGB(.8, .8, .8), .3));
+    result.objects.add(std::make_unique<TriangleMesh>(grey, std::move(positions), std::move(normals), std::move(triangles)));
+    result.lights.push_back(Light::point(point3(0, -1, -1), RGB(1, 1, 1)));
+    return result;
+}
+
+// resident memory of the process in bytes
+size_t resident_bytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// rays and shadow rays traced by all threads so far
+uint64_t traced_rays()
+{
+    uint64_t rays = 0;
+    for (const ThreadSummary &thread : Profiler::get().thread_summaries())
+        rays += thread.rays + thread.shadow_rays;
+    return rays;
+}
+}
+
+/*
+* One frame of a canonical scene per iteration
+*/
+static void BM_Scene(benchmark::State &state, CanonicalScene (*build)())
+{
+    CanonicalScene scene = build();
+    BVH bvh(scene.objects);
+    double scene_mb = (scene.objects.memory().total() + bvh.memory_size()) / 1048576.0;
+
+    LightSet lights(scene.lights);
+    scene.settings.lights = &lights;
+    scene.cam.aspect_ratio = 4. / 3.;
+    scene.cam.image_width = SUITE_WIDTH;
+    auto u = scene.cam.init();
+    Framebuffer frame_buffer(scene.cam.image_width, scene.cam.image_height);
+    ThreadPool pool;
+
+    RenderStats stats;
+    uint64_t rays_before = traced_rays();
+    auto start = std::chrono::steady_clock::now();
+    for (auto _ : state)
+    {
+        stats = rt_scene(u, scene.objects, bvh, scene.cam, frame_buffer, pool, scene.settings);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    state.counters["Mrays_per_s"] = (traced_rays() - rays_before) / seconds / 1e6;
+    state.counters["segments_per_path"] = stats.average_bounces();
+    state.counters["scene_MB"] = scene_mb;
+    state.counters["resident_MB"] = resident_bytes() / 1048576.0;
+}
+BENCHMARK_CAPTURE(BM_Scene, large_primitives, large_primitives)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Scene, random_spheres, random_spheres)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Scene, mirror_box, mirror_box)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Scene, triangle_heavy, triangle_heavy)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+namespace
+{
+/*
+* Console output that also keeps the real time of every run in milliseconds for the baseline comparison
+*/
+class CollectingReporter : public benchmark::ConsoleReporter
+{
+public:
+    std::map<std::string, double> times_ms;
+
+    using ConsoleReporter::ConsoleReporter;
+
+    void ReportRuns(const std::vector<Run> &reports) override
+    {
+        for (const Run &run : reports)
+        {
+            if (!run.error_occurred)
+                times_ms[run.benchmark_name()] = run.GetAdjustedRealTime() / benchmark::GetTimeUnitMultiplier(run.time_unit) * 1e3;
+        }
+        ConsoleReporter::ReportRuns(reports);
+    }
+};
+
+// value of "key": on a line of the pretty printed benchmark JSON, quotes removed
+bool json_value(const std::string &line, const char *key, std::string &value)
+{
+    size_t position = line.find(std::string("\"") + key + "\":");
+    if (position == std::string::npos)
+        return false;
+    value = line.substr(position + std::strlen(key) + 3);
+    size_t first = value.find_first_not_of(" \"");
+    size_t last = value.find_last_not_of(" \",");
+    value = first == std::string::npos ? "" : value.substr(first, last - first + 1);
+    return true;
+}
+
+/*
+* Real times in milliseconds of the runs in a file written with --benchmark_out, which prints one key per line
+*/
+bool load_baseline(const std::string &path, std::map<std::string, double> &times_ms)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+    const std::map<std::string, double> to_ms = {{"ns", 1e-6}, {"us", 1e-3}, {"ms", 1}, {"s", 1e3}};
+    std::string line, value, name;
+    double real_time = 0;
+    bool in_benchmarks = false;
+    while (std::getline(file, line))
+    {
+        if (line.find("\"benchmarks\":") != std::string::npos)
+            in_benchmarks = true;
+        else if (!in_benchmarks)
+            continue;
+        else if (json_value(line, "name", value))
+            name = value;
+        else if (json_value(line, "real_time", value))
+            real_time = std::strtod(value.c_str(), nullptr);
+        else if (json_value(line, "time_unit", value) && to_ms.count(value))
+            times_ms[name] = real_time * to_ms.at(value);
+    }
+    if (times_ms.empty())
+    {
+        std::cerr << path << ": no benchmark results" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// prints the change of every run against the baseline, returns the number of regressions
+int compare(const std::map<std::string, double> &baseline, const std::map<std::string, double> &current, double threshold)
+{
+    int regressions = 0;
+    std::cout << std::fixed << std::setprecision(2) << "\n" << std::left << std::setw(48) << "Comparison with baseline"
+              << std::right << std::setw(12) << "baseline" << std::setw(12) << "current" << std::setw(10) << "change" << "\n";
+    for (const auto &[name, time] : current)
+    {
+        auto found = baseline.find(name);
+        if (found == baseline.end())
+        {
+            std::cout << std::left << std::setw(48) << name << std::right << std::setw(12) << "-" << std::setw(12) << time << "\n";
+            continue;
+        }
+        double change = (time / found->second - 1) * 100;
+        bool regression = change > threshold;
+        regressions += regression;
+        std::cout << std::left << std::setw(48) << name << std::right << std::setw(12) << found->second << std::setw(12) << time
+                  << std::setw(9) << std::showpos << change << std::noshowpos << "%" << (regression ? "  REGRESSION" : "") << "\n";
+    }
+    std::cout << std::defaultfloat;
+    return regressions;
+}
+}
+
+int main(int argc, char **argv)
+{
+    // take the comparison options out before Google Benchmark sees the arguments
+    std::string baseline_path;
+    double threshold = DEFAULT_THRESHOLD;
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--baseline") && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = std::atof(argv[++i]);
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty() && !load_baseline(baseline_path, baseline))
+        return 1;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    CollectingReporter reporter(isatty(STDOUT_FILENO) ? benchmark::ConsoleReporter::OO_Defaults
+                                                      : benchmark::ConsoleReporter::OO_Tabular);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    if (baseline_path.empty())
+        return 0;
+    int regressions = compare(baseline, reporter.times_ms, threshold);
+    if (regressions > 0)
+    {
+        std::cout << regressions << " benchmark(s) more than " << threshold << "% slower than " << baseline_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include "temporal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "instance.h"
+#include "profiler.h"
+
+namespace
+{
+// splat entry of a pixel no surface was moved to
+constexpr uint64_t EMPTY_SPLAT = ~0ull;
+
+uint64_t splat_key(float distance, uint32_t source)
+{
+    // the bits of positive floats sort like their values, so the smallest key is the closest surface
+    uint32_t bits;
+    std::memcpy(&bits, &distance, sizeof(float));
+    return static_cast<uint64_t>(bits) << 32 | source;
+}
+
+float splat_depth(uint64_t key)
+{
+    uint32_t bits = key >> 32;
+    float distance;
+    std::memcpy(&distance, &bits, sizeof(float));
+    return distance;
+}
+
+void atomic_min(std::atomic<uint64_t> &target, uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+// true if the pixel is in the subset that is traced again this frame
+bool refresh_pixel(size_t pixel, int frame, int interval)
+{
+    // hashing spreads the refreshed pixels over the image instead of tracing whole rows, the mixing steps are the
+    // finalizer of MurmurHash3
+    uint32_t h = static_cast<uint32_t>(pixel);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h % interval == static_cast<uint32_t>(frame % interval);
+}
+}
+
+TemporalRenderer::TemporalRenderer(int width, int height)
+{
+    resize(width, height);
+}
+
+void TemporalRenderer::resize(int width, int height)
+{
+    colors.resize(width, height);
+    next_colors.resize(width, height);
+    splat.reset(new std::atomic<uint64_t>[static_cast<size_t>(width) * height]);
+    valid = false;
+    size_t pixels = static_cast<size_t>(width) * height;
+    depth.assign(pixels, 0);
+    next_depth.assign(pixels, 0);
+    object.assign(pixels, -1);
+    next_object.assign(pixels, -1);
+}
+
+/*
+* Move the hit points of the previous frame into the splat buffer of the view of cam. A hit point P is seen
+* through the image position (x, y) if P - position = a * (position - image_top_left - u[0] x - u[1] y) for
+* some a > 0. Solving that for (a, a x, a y) is one inverse 3x3 matrix per frame, a is the new ray parameter.
+*/
+void TemporalRenderer::reproject(const Scene &scene, const Camera &cam, const std::vector<vec3> &u, ThreadPool &pool,
+                                 const RenderSettings &render_settings)
+{
+    int width = colors.get_width(), height = colors.get_height();
+    Transform view;
+    vec3 axis = cam.position - cam.image_top_left;
+    for (int r = 0; r < 3; r++)
+    {
+        view.m[r][0] = axis[r];
+        view.m[r][1] = -u[0][r];
+        view.m[r][2] = -u[1][r];
+        view.m[r][3] = 0;
+    }
+    Transform projection = view.inverse();
+
+    pool.parallel_for((height + TILE_SIZE - 1) / TILE_SIZE, [&](int band, int) {
+        PROFILE_SCOPE("reproject");
+        for (int i = band * TILE_SIZE; i < std::min((band + 1) * TILE_SIZE, height); i++)
+        {
+            for (int j = 0; j < width; j++)
+            {
+                size_t pixel = static_cast<size_t>(i) * width + j;
+                if (object[pixel] < 0)
+                    continue;
+                const Material &mat = scene.material(scene[object[pixel]]->material_index());
+                if (mat.metallic > settings.max_metallic)
+                    continue;
+                vec3 old_direction = position - (image_top_left + delta_x * (j + jitter_x) + delta_y * (i + jitter_y));
+                vec3 offset = position + old_direction * depth[pixel] - cam.position;
+                vec3 solution = projection.vector(offset);
+                if (solution.x <= 0)
+                    continue;
+                long x = std::lround(solution.y / solution.x - render_settings.jitter_x);
+                long y = std::lround(solution.z / solution.x - render_settings.jitter_y);
+                if (x < 0 || y < 0 || x >= width || y >= height)
+                    continue;
+                atomic_min(splat[static_cast<size_t>(y) * width + x], splat_key(solution.x, pixel));
+            }
+        }
+    });
+}
+
+const TemporalStats &TemporalRenderer::render(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                                              ThreadPool &pool, const RenderSettings &render_settings, Framebuffer &output)
+{
+    int width = cam.image_width, height = cam.image_height;
+    size_t pixels = static_cast<size_t>(width) * height;
+    if (width != colors.get_width() || height != colors.get_height())
+        resize(width, height);
+    bool trace_all = !valid || scene.geometry_revision() != geometry_revision || scene.material_revision() != material_revision ||
+                     settings.refresh_interval <= 1;
+    if (!valid || scene.geometry_revision() != geometry_revision || scene.material_revision() != material_revision)
+        current.resets++;
+
+    for (size_t pixel = 0; pixel < pixels; pixel++)
+        splat[pixel].store(EMPTY_SPLAT, std::memory_order_relaxed);
+    if (!trace_all)
+        reproject(scene, cam, u, pool, render_settings);
+
+    std::atomic<int64_t> reused{0};
+    // copies the surface that was moved to the pixel if it is kept, see the class comment
+    auto reproject_pixel = [&](int i, int j) {
+        size_t pixel = static_cast<size_t>(i) * width + j;
+        uint64_t key = splat[pixel].load(std::memory_order_relaxed);
+        if (key == EMPTY_SPLAT || refresh_pixel(pixel, frame, settings.refresh_interval))
+            return false;
+        // the closest surface moved to any neighbour, a much farther one here shows through a gap
+        float nearest = splat_depth(key);
+        for (int ni = std::max(i - 1, 0); ni <= std::min(i + 1, height - 1); ni++)
+        {
+            for (int nj = std::max(j - 1, 0); nj <= std::min(j + 1, width - 1); nj++)
+            {
+                uint64_t neighbour = splat[static_cast<size_t>(ni) * width + nj].load(std::memory_order_relaxed);
+                if (neighbour != EMPTY_SPLAT)
+                    nearest = std::min(nearest, splat_depth(neighbour));
+            }
+        }
+        if (splat_depth(key) > nearest * (1 + settings.depth_tolerance))
+            return false;
+        size_t source = key & 0xFFFFFFFFu;
+        next_colors.set(i, j, colors.get(source / width, source % width));
+        next_depth[pixel] = splat_depth(key);
+        next_object[pixel] = object[source];
+        return true;
+    };
+    auto store = [&](int i, int j, const ray &r, const Collision &col, int &segments) {
+        size_t pixel = static_cast<size_t>(i) * width + j;
+        next_colors.set(i, j, trace_path(scene, bvh, r, col, render_settings, segments));
+        next_depth[pixel] = col.distance;
+        next_object[pixel] = col.hit_object_index;
+    };
+
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    pool.parallel_for(tiles_x * tiles_y, [&](int tile, int) {
+        PROFILE_SCOPE("tile");
+        int tile_x = (tile % tiles_x) * TILE_SIZE;
+        int tile_y = (tile / tiles_x) * TILE_SIZE;
+        int row_end = std::min(tile_y + TILE_SIZE, height), column_end = std::min(tile_x + TILE_SIZE, width);
+        int segments = 0;
+        int64_t tile_reused = 0;
+        for (int row = tile_y; row < row_end; row += PACKET_WIDTH)
+        {
+            for (int column = tile_x; column < column_end; column += PACKET_WIDTH)
+            {
+                // lanes of the block that are traced
+                uint32_t trace = 0;
+                int trace_count = 0;
+                for (int lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    int i = row + lane / PACKET_WIDTH;
+                    int j = column + lane % PACKET_WIDTH;
+                    if (i >= row_end || j >= column_end)
+                        continue;
+                    if (reproject_pixel(i, j))
+                    {
+                        tile_reused++;
+                        continue;
+                    }
+                    trace |= 1u << lane;
+                    trace_count++;
+                }
+                if (render_settings.packets && trace_count >= PACKET_SIZE / 2)
+                {
+                    // mostly traced blocks, like the sky, are as cheap as in rt_scene
+                    RayPacket packet;
+                    packet.origin = cam.position;
+                    for (int lane = 0; lane < PACKET_SIZE; lane++)
+                    {
+                        auto pixel_center = cam.image_top_left + u[0] * (column + lane % PACKET_WIDTH + render_settings.jitter_x) +
+                                            u[1] * (row + lane / PACKET_WIDTH + render_settings.jitter_y);
+                        packet.set_direction(lane, cam.position - pixel_center);
+                    }
+                    packet.active = trace;
+                    packet.finalize();
+                    Collision collisions[PACKET_SIZE];
+                    bvh.closest_hit(scene, packet, collisions);
+                    for (int lane = 0; lane < PACKET_SIZE; lane++)
+                    {
+                        if (trace & (1u << lane))
+                            store(row + lane / PACKET_WIDTH, column + lane % PACKET_WIDTH, packet.lane_ray(lane), collisions[lane], segments);
+                    }
+                    continue;
+                }
+                for (int lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    if (!(trace & (1u << lane)))
+                        continue;
+                    int i = row + lane / PACKET_WIDTH;
+                    int j = column + lane % PACKET_WIDTH;
+                    ray r = primary_ray(u, cam, j + render_settings.jitter_x, i + render_settings.jitter_y);
+                    store(i, j, r, find_closest_hit(scene, bvh, r), segments);
+                }
+            }
+        }
+        reused += tile_reused;
+    });
+
+    std::swap(colors, next_colors);
+    depth.swap(next_depth);
+    object.swap(next_object);
+    position = cam.position;
+    image_top_left = cam.image_top_left;
+    delta_x = u[0];
+    delta_y = u[1];
+    jitter_x = render_settings.jitter_x;
+    jitter_y = render_settings.jitter_y;
+    geometry_revision = scene.geometry_revision();
+    material_revision = scene.material_revision();
+    valid = true;
+    frame++;
+
+    current.pixels = pixels;
+    current.reused = reused;
+    output.copy_from(colors);
+    return current;
+}
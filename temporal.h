@@ -0,0 +1,76 @@
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "renderer.h"
+#include "framebuffer.h"
+
+/*
+* quality knobs of the temporal reprojection, the defaults favour speed during camera motion
+*/
+struct TemporalSettings
+{
+    // every pixel is traced again at least every refresh_interval frames, 1 traces every pixel of every frame
+    int refresh_interval = 8;
+    // reprojected surfaces that reflect more than this are traced, their reflections move with the view. Most
+    // materials reflect, by default their reflections lag behind by up to refresh_interval frames instead
+    double max_metallic = 1;
+    // a reprojected pixel behind its nearest neighbour by more than this fraction of the distance is traced, it
+    // may be background showing through a gap in a closer surface
+    double depth_tolerance = 0.1;
+};
+
+struct TemporalStats
+{
+    // pixels of the last frame and how many of them were reprojected instead of traced
+    int64_t pixels = 0, reused = 0;
+    // number of frames traced completely, i.e. after the scene changed
+    int resets = 0;
+    double reused_fraction() const { return pixels > 0 ? static_cast<double>(reused) / pixels : 0; }
+};
+
+/*
+* Reuses the pixels of the previous frame while the camera moves. Every pixel of the previous frame that saw a
+* surface is moved to where its hit point appears from the new camera, the closest one wins a pixel. Pixels no
+* surface moved to (disocclusions, the sky, the image border), pixels failing the depth test or showing a material
+* above settings.max_metallic and a rotating subset of 1 / refresh_interval of all pixels are traced. The whole frame is
+* traced when the scene, its materials or the image size changed or after reset(). The traced pixels are scattered
+* over the image, so they always use the depth first tracer, settings.wavefront is ignored.
+*/
+class TemporalRenderer
+{
+    Framebuffer colors, next_colors;
+    // primary ray parameter and object of the hit, -1 for the sky
+    std::vector<double> depth, next_depth;
+    std::vector<int> object, next_object;
+    // per pixel of the new frame the depth as float bits in the high and the source pixel in the low half
+    std::unique_ptr<std::atomic<uint64_t>[]> splat;
+    // view of the previous frame, see Camera::init
+    point3 position, image_top_left;
+    vec3 delta_x, delta_y;
+    double jitter_x = 0, jitter_y = 0;
+    unsigned geometry_revision = 0, material_revision = 0;
+    bool valid = false;
+    int frame = 0;
+    TemporalStats current;
+
+    void resize(int width, int height);
+    void reproject(const Scene &scene, const Camera &cam, const std::vector<vec3> &u, ThreadPool &pool,
+                   const RenderSettings &render_settings);
+
+public:
+    TemporalSettings settings;
+
+    TemporalRenderer(int width, int height);
+
+    // trace the next frame completely, i.e. after the lights changed
+    void reset() { valid = false; }
+    const TemporalStats &render(const std::vector<vec3> &u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                                ThreadPool &pool, const RenderSettings &render_settings, Framebuffer &output);
+    const TemporalStats &stats() const { return current; }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+#include <string>
+
+#include "profiler.h"
+
+ThreadPool::ThreadPool(int thread_count)
+{
+    if (thread_count <= 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    // worker 0 is the thread calling parallel_for
+    for (int i = 1; i < thread_count; i++)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    start_condition.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::worker_loop(int worker)
+{
+    Profiler::get().set_thread_name("worker " + std::to_string(worker));
+    uint64_t seen_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&] { return stop || generation != seen_generation; });
+            if (stop)
+                return;
+            seen_generation = generation;
+        }
+        run_tasks(worker);
+    }
+}
+
+/*
+* Take work from the own queue first and steal from the front of the other queues once it is empty
+*/
+bool ThreadPool::pop_task(int worker, int &task)
+{
+    {
+        WorkQueue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (int i = 1; i < static_cast<int>(queues.size()); i++)
+    {
+        WorkQueue &victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_tasks(int worker)
+{
+    int task;
+    while (pop_task(worker, task))
+    {
+        (*job)(task, worker);
+        if (--remaining == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done_condition.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int, int)> &task)
+{
+    if (count <= 0)
+        return;
+
+    // the job has to be set before the first task becomes visible in a queue
+    job = &task;
+    remaining = count;
+
+    // hand out contiguous blocks so neighbouring tasks start on the same worker
+    int worker_count = queues.size();
+    for (int w = 0; w < worker_count; w++)
+    {
+        int begin = static_cast<int64_t>(count) * w / worker_count;
+        int end = static_cast<int64_t>(count) * (w + 1) / worker_count;
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        // workers pop from the back, so push in reverse to process the block in order
+        for (int i = end - 1; i >= begin; i--)
+        {
+            queues[w]->tasks.push_back(i);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+    }
+    start_condition.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [&] { return remaining == 0; });
+}
@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* Persistent pool of worker threads with one task queue per worker. Idle workers steal tasks from the
+* other queues, so expensive tasks (i.e. tiles full of reflections) do not leave the other threads waiting.
+* The thread calling parallel_for takes part in the work as worker 0, so a pool of size 1 runs serially.
+*/
+class ThreadPool
+{
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+    uint64_t generation = 0;
+    bool stop = false;
+
+    const std::function<void(int, int)> *job = nullptr;
+    std::atomic<int> remaining{0};
+
+    void worker_loop(int worker);
+    void run_tasks(int worker);
+    bool pop_task(int worker, int &task);
+
+public:
+    // thread_count includes the calling thread, 0 selects the number of hardware threads
+    explicit ThreadPool(int thread_count = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return queues.size(); }
+
+    // call task(index, worker) for every index in [0, count) and block until all calls returned.
+    // Must not be called from several threads at the same time.
+    void parallel_for(int count, const std::function<void(int, int)> &task);
+};
+
+#endif
@@ -2,40 +2,131 @@
 #define VEC3
 #include <cmath>
 #include <iostream>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 /*
 using struct here because of ISO Cpp C.2 guideline:
 The components of a vector can vary independently without producing something
 like an "invalid vector".
+
+The vector is a header only template over the scalar type, so every operator can be inlined into the
+renderer. vec3 (double) is used by the renderer, vec3f and vec3_simd are the float versions.
+*/
+template <typename T>
+class vec3_t
+{
+    public :
+    using scalar = T;
+    T x,y,z;
+
+    vec3_t(): x{0},y{0},z{0}{}
+    vec3_t(T x_val, T y_val, T z_val) : x{x_val}, y{y_val}, z{z_val}{}
+
+    T length() const { return std::sqrt(length_squared()); }
+    T length_squared() const { return x*x + y*y + z*z; }
+
+    vec3_t normalize() const { return *this / length(); }
+
+    vec3_t operator+(const vec3_t &other) const { return vec3_t(x + other.x, y + other.y, z + other.z); }
+    vec3_t operator-() const { return vec3_t(-x, -y, -z); }
+    vec3_t operator-(const vec3_t &other) const { return vec3_t(x - other.x, y - other.y, z - other.z); }
+    vec3_t operator*(const vec3_t &other) const { return vec3_t(x * other.x, y * other.y, z * other.z); }
+    vec3_t operator*(const T d) const { return vec3_t(x * d, y * d, z * d); }
+    vec3_t operator/(const T t) const { return vec3_t(x / t, y / t, z / t); }
+    // component access by axis index, 0 = x, 1 = y, 2 = z
+    T operator[](int axis) const { return axis == 0 ? x : (axis == 1 ? y : z); }
+    void print() const { std::cout << x << " " << y << " " << z << " " << std::endl; }
+
+    static vec3_t linear_interp(const vec3_t &first, const vec3_t &second, T d)
+    {
+        return vec3_t(first.x + d * (second.x - first.x),
+                      first.y + d * (second.y - first.y),
+                      first.z + d * (second.z - first.z));
+    }
+    // mirror v at the plane with the given unit normal, the length of v is kept
+    static vec3_t reflect(const vec3_t &v, const vec3_t &normal) { return v - normal * (2 * dot(v, normal)); }
+    static T dot(const vec3_t &v1, const vec3_t &v2) { return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z; }
+    static vec3_t cross(const vec3_t &u, const vec3_t &v)
+    {
+        return vec3_t(u.y * v.z - u.z * v.y,
+                      u.z * v.x - u.x * v.z,
+                      u.x * v.y - u.y * v.x);
+    }
+};
+
+#if defined(__SSE2__)
+// tag selecting the float vector stored in one SSE register
+struct simd4f;
+
+/*
+* float vector kept in an SSE register with an unused fourth lane. The components are read through x(), y(), z()
+* and operator[], not through a union with named floats, which is not standard C++.
 */
-class vec3
+template <>
+class alignas(16) vec3_t<simd4f>
 {
+    static __m128 horizontal_sum(__m128 v)
+    {
+        // lane 3 is always zero, so summing all four lanes gives x + y + z in every lane
+        __m128 pairs = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_add_ps(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+
     public :
-    double x,y,z;
-
-    vec3(): x{0},y{0},z{0}{}
-    vec3(double x_val, double y_val, double z_val) : x{x_val}, y{y_val}, z{z_val}{}
-
-    double length() const;
-    double length_squared() const;
-    
-    vec3 normalize() const;
-    
-    vec3 operator+(const vec3 other) const;
-    vec3 operator-() const;   
-    vec3 operator-(const vec3 other) const;
-    vec3 operator*(const vec3 other) const;
-    vec3 operator*(const double d) const;
-    vec3 operator/(const double t) const;
-    void print()const;
-
-    static vec3 linear_interp(const vec3 first, const vec3 second, double d);
-    static vec3 reflect(const vec3 v , const vec3 normal) ;
-    static double dot(const vec3 v1,const vec3 v2);
-    static vec3 cross(const vec3 &u, const vec3 &v);
+    using scalar = float;
+    __m128 v;
+
+    vec3_t() : v{_mm_setzero_ps()} {}
+    vec3_t(float x_val, float y_val, float z_val) : v{_mm_setr_ps(x_val, y_val, z_val, 0)} {}
+    explicit vec3_t(__m128 value) : v{value} {}
+
+    float length() const { return std::sqrt(length_squared()); }
+    float length_squared() const { return dot(*this, *this); }
+
+    vec3_t normalize() const { return vec3_t(_mm_div_ps(v, _mm_sqrt_ps(horizontal_sum(_mm_mul_ps(v, v))))); }
+
+    vec3_t operator+(const vec3_t &other) const { return vec3_t(_mm_add_ps(v, other.v)); }
+    vec3_t operator-() const { return vec3_t(_mm_sub_ps(_mm_setzero_ps(), v)); }
+    vec3_t operator-(const vec3_t &other) const { return vec3_t(_mm_sub_ps(v, other.v)); }
+    vec3_t operator*(const vec3_t &other) const { return vec3_t(_mm_mul_ps(v, other.v)); }
+    vec3_t operator*(const float d) const { return vec3_t(_mm_mul_ps(v, _mm_set1_ps(d))); }
+    vec3_t operator/(const float t) const { return vec3_t(_mm_div_ps(v, _mm_set1_ps(t))); }
+    float x() const { return _mm_cvtss_f32(v); }
+    float y() const { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); }
+    float z() const { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))); }
+    float operator[](int axis) const { return axis == 0 ? x() : (axis == 1 ? y() : z()); }
+    void print() const { std::cout << x() << " " << y() << " " << z() << " " << std::endl; }
+
+    static vec3_t linear_interp(const vec3_t &first, const vec3_t &second, float d)
+    {
+        return vec3_t(_mm_add_ps(first.v, _mm_mul_ps(_mm_set1_ps(d), _mm_sub_ps(second.v, first.v))));
+    }
+    static vec3_t reflect(const vec3_t &v, const vec3_t &normal)
+    {
+        __m128 twice_dot = _mm_mul_ps(_mm_set1_ps(2), horizontal_sum(_mm_mul_ps(v.v, normal.v)));
+        return vec3_t(_mm_sub_ps(v.v, _mm_mul_ps(normal.v, twice_dot)));
+    }
+    static float dot(const vec3_t &v1, const vec3_t &v2) { return _mm_cvtss_f32(horizontal_sum(_mm_mul_ps(v1.v, v2.v))); }
+    static vec3_t cross(const vec3_t &u, const vec3_t &v)
+    {
+        // (u.y v.z - u.z v.y, u.z v.x - u.x v.z, u.x v.y - u.y v.x) with the lanes rotated as y z x
+        __m128 u_yzx = _mm_shuffle_ps(u.v, u.v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 v_yzx = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 rotated = _mm_sub_ps(_mm_mul_ps(u.v, v_yzx), _mm_mul_ps(u_yzx, v.v));
+        return vec3_t(_mm_shuffle_ps(rotated, rotated, _MM_SHUFFLE(3, 0, 2, 1)));
+    }
 };
 
+using vec3_simd = vec3_t<simd4f>;
+#else
+using vec3_simd = vec3_t<float>;
+#endif
+
+using vec3 = vec3_t<double>;
+using vec3f = vec3_t<float>;
 using point3 = vec3;
 using RGB = vec3;
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,405 @@
+#include <iostream>
+#include <cmath>
+#include <SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <filesystem>
+#include <cstdio>
+
+#include "viewer.h"
+#include "frame_pipeline.h"
+#include "progressive.h"
+#include "scene_file.h"
+#include "profiler.h"
+
+#define RENDER_SCENE
+// #define TEXTURE_TEST
+
+const bool performance_logging = true;
+// how often the scene file is checked for changes
+constexpr auto SCENE_CHECK_INTERVAL = std::chrono::milliseconds(500);
+// how often the frame time percentiles in the window title are refreshed
+constexpr auto TITLE_INTERVAL = std::chrono::milliseconds(500);
+
+/*
+* Replace the objects and lights that came from the scene file and rebuild the hierarchy. The caller makes sure
+* no frame is being traced. The camera stays where the user moved it. Keeps the old scene if the file can not be parsed.
+* When only materials or lights were edited the render cache keeps its primary hits, otherwise it is invalidated.
+*/
+static bool reload_scene(Scene &scene, BVH &bvh, const Camera &cam, const ViewerOptions &options,
+                         size_t &file_objects, uint64_t &file_hash, RenderCache &cache)
+{
+    Scene reloaded;
+    Camera file_cam = cam;
+    std::vector<Light> lights;
+    SceneLoadStats stats;
+    if (!load_scene(options.scene_file, reloaded, file_cam, lights, &stats))
+        return false;
+    if (options.lights)
+        *options.lights = LightSet(std::move(lights));
+    // objects added after the file, like --mesh, are loaded meshes the new scene can take over
+    for (size_t i = file_objects; i < scene.size(); i++)
+    {
+        std::unique_ptr<SceneGeometry> object = scene.release(i);
+        if (!object)
+            continue;
+        object->set_material_index(reloaded.add_material(scene.material(object->material_index())));
+        reloaded.add(std::move(object));
+    }
+    scene = std::move(reloaded);
+    file_objects = stats.objects;
+
+    auto build_start_time = std::chrono::high_resolution_clock::now();
+    bvh.build(scene);
+    double build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - build_start_time).count();
+    std::cout << "Reloaded " << options.scene_file << ": " << stats.objects << " objects and " << stats.lights << " lights parsed in " << stats.parse_ms
+              << " ms, hierarchy built in " << build_ms << " ms" << std::endl;
+    if (stats.geometry_hash == file_hash)
+        cache.keep_hits(scene);
+    else
+        cache.invalidate();
+    file_hash = stats.geometry_hash;
+    return true;
+}
+
+/*
+* The interactive main loop lives here
+*/
+int run_viewer(Scene &scene, BVH &bvh, Camera &cam, std::vector<vec3> u,
+               ThreadPool &pool, const RenderSettings &settings, const ViewerOptions &options)
+{
+    int frame_number = 0;
+
+    // SDL setup adapted from the resource linked in the task description
+    // https://lazyfoo.net/tutorials/SDL/01_hello_SDL/index2.php
+    SDL_Window *window = NULL;
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+    }
+    else
+    {
+        // Create window
+        window = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, cam.image_width, cam.image_height, SDL_WINDOW_SHOWN);
+        if (window == NULL)
+        {
+            printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        }
+        else
+        {
+            SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+            if (!renderer)
+            {
+                std::cerr << "Renderer creation failed: " << SDL_GetError() << std::endl;
+                SDL_DestroyWindow(window);
+                SDL_Quit();
+                return 1;
+            }
+
+            // the texture is created once and updated in place every frame. RGBA8888 is a packed format with red in
+            // the highest byte, which is the default PixelLayout of the frame buffer conversion
+            SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, cam.image_width, cam.image_height);
+            if (!texture)
+            {
+                std::cerr << "Texture creation failed: " << SDL_GetError() << std::endl;
+                SDL_DestroyRenderer(renderer);
+                SDL_DestroyWindow(window);
+                SDL_Quit();
+                return 1;
+            }
+            PixelLayout layout;
+
+            /*
+            Frames are traced on the pipeline's render thread into a ring of frame buffers while this thread
+            handles input and presents the previous frame. The pool is only used by the render thread, the
+            conversion into the texture runs here so it overlaps with tracing.
+            */
+            ProgressiveRenderer progressive(cam.image_width, cam.image_height);
+            RenderCache cache(cam.image_width, cam.image_height);
+            TemporalRenderer temporal(cam.image_width, cam.image_height);
+            temporal.settings = options.temporal_settings;
+            // percentage of the pixels of the last frame that were reprojected, written by the render thread
+            std::atomic<int> reused_percent{0};
+            DynamicResolution dynamic_resolution(options.resolution_settings);
+            // render scale of the last frame in percent, written by the render thread
+            std::atomic<int> scale_percent{100};
+            // the last frame was copied from the cache, written by the render thread
+            std::atomic<bool> frame_reused{false};
+            // statistics of the last progressive frame, written by the render thread
+            std::atomic<int> samples_per_pixel{0};
+            std::atomic<bool> converged{false};
+            // totals of the adaptive anti-aliasing, written by the render thread
+            std::atomic<int64_t> adaptive_extra_rays{0}, adaptive_edge_pixels{0};
+            std::atomic<int> adaptive_frames{0};
+            std::atomic<int64_t> traced_paths{0}, traced_segments{0};
+            FramePipeline pipeline(options.frame_buffers, cam.image_width, cam.image_height, options.precision,
+                                   [&](const Camera &frame_cam, Framebuffer &frame_buffer) {
+#if defined(RENDER_SCENE)
+                                       if (options.progressive)
+                                       {
+                                           const ProgressiveStats &stats = progressive.render(u, scene, bvh, frame_cam, pool, settings, frame_buffer);
+                                           samples_per_pixel = stats.samples_per_pixel;
+                                           converged = stats.converged;
+                                           if (stats.average_bounces > 0)
+                                           {
+                                               traced_paths += frame_cam.image_width * frame_cam.image_height;
+                                               traced_segments += static_cast<int64_t>(stats.average_bounces * frame_cam.image_width * frame_cam.image_height);
+                                           }
+                                       }
+                                       else if (options.adaptive)
+                                       {
+                                           AdaptiveStats stats = rt_adaptive(u, scene, bvh, frame_cam, frame_buffer, pool, settings,
+                                                                             options.adaptive_settings, 0, frame_cam.image_height);
+                                           adaptive_extra_rays += stats.extra_rays;
+                                           adaptive_edge_pixels += stats.edge_pixels;
+                                           adaptive_frames++;
+                                           traced_paths += stats.primary_rays + stats.extra_rays;
+                                           traced_segments += stats.segments;
+                                       }
+                                       else if (options.temporal)
+                                       {
+                                           const TemporalStats &stats = temporal.render(u, scene, bvh, frame_cam, pool, settings, frame_buffer);
+                                           reused_percent = static_cast<int>(stats.reused_fraction() * 100 + .5);
+                                       }
+                                       else if (options.dynamic_resolution)
+                                       {
+                                           const ResolutionStats &stats = dynamic_resolution.render(u, scene, bvh, frame_cam, pool, settings, frame_buffer);
+                                           scale_percent = static_cast<int>(stats.scale * 100 + .5);
+                                       }
+                                       else if (options.cache)
+                                       {
+                                           const RenderCacheStats &stats = cache.render(u, scene, bvh, frame_cam, pool, settings, frame_buffer);
+                                           frame_reused = stats.last == CacheLevel::Reused;
+                                           if (!frame_reused)
+                                           {
+                                               traced_paths += frame_cam.image_width * frame_cam.image_height;
+                                               traced_segments += static_cast<int64_t>(stats.average_bounces * frame_cam.image_width * frame_cam.image_height);
+                                           }
+                                       }
+                                       else
+                                       {
+                                           RenderStats stats = rt_scene(u, scene, bvh, frame_cam, frame_buffer, pool, settings);
+                                           traced_paths += stats.paths;
+                                           traced_segments += stats.segments;
+                                       }
+#endif
+                                   });
+            int shown_samples = -1;
+            auto title_time = std::chrono::steady_clock::now();
+            const int frame_stage = Profiler::get().stage("frame");
+            pipeline.submit(cam);
+
+            std::error_code time_error;
+            size_t scene_file_objects = options.scene_file_objects;
+            uint64_t scene_file_hash = options.scene_file_hash;
+            auto scene_file_time = std::filesystem::last_write_time(options.scene_file, time_error);
+            auto scene_check_time = std::chrono::steady_clock::now();
+
+            SDL_Event e;
+            bool quit = false;
+
+            int mouse_x, mouse_y = 0;
+
+            while (quit == false)
+            {
+                ScopedTimer frame_timer("frame", frame_stage);
+
+                while (SDL_PollEvent(&e))
+                {
+                    if (e.type == SDL_QUIT)
+                        quit = true;
+
+                    // handle key presses
+                    else if (e.type == SDL_KEYDOWN)
+                    {
+
+                        switch (e.key.keysym.sym)
+                        {
+                        case SDLK_UP:
+                            cam.forward();
+                            break;
+
+                        case SDLK_DOWN:
+                            cam.backward();
+                            break;
+
+                        case SDLK_LEFT:
+                            cam.left();
+                            break;
+
+                        case SDLK_RIGHT:
+                            cam.right();
+                            break;
+
+                        case SDLK_a:
+                            cam.left();
+                            break;
+
+                        case SDLK_s:
+                            cam.backward();
+                            break;
+
+                        case SDLK_d:
+                            cam.right();
+                            break;
+
+                        case SDLK_w:
+                            cam.forward();
+                            break;
+
+                        case SDLK_q:
+                            quit = true;
+                            break;
+
+                        case SDLK_r:
+                            // cam = Camera(vec3(1,0,0), point3(0,0,0), 35.0, ASPECT_RATIO, cam.image_width,0.1);
+                            break;
+
+                        default:
+                            break;
+                        }
+                    }
+                }
+                /*
+                The code for rotating the mouse. We would have liked to implement camera movement like in first person games,
+                but unfortunately, the functionality necessary to relative use mouse movements without movements being blocked
+                by the window borders is not available for WSL2 GUI windows. We tried both capturing the cursor and warping the
+                cursor to the center of the window. Neither works in WSL2, but they break the close window button.
+                The final product is kinda janky, but it allows for unlimited
+                rotation, unlike the other implementations, which would have been limited in how far the camera can be rotated.
+                Also, this solution does not mess with the close window button, like the other implementations did.
+                */
+                int x, y = 0;
+                // SDL_GetMouseState(&x, &y);
+                // float x_input = (x - cam.image_width / 2) / static_cast<double>(cam.image_width / 2);
+                // float y_input = (y - cam.image_height / 2) / static_cast<double>(cam.image_height / 2);
+                // cam.rotate_left_right(-x_input * .05);
+                // cam.rotate_up_down(-y_input * .05);
+
+
+                if (!options.scene_file.empty() && std::chrono::steady_clock::now() - scene_check_time > SCENE_CHECK_INTERVAL)
+                {
+                    scene_check_time = std::chrono::steady_clock::now();
+                    auto write_time = std::filesystem::last_write_time(options.scene_file, time_error);
+                    if (!time_error && write_time != scene_file_time)
+                    {
+                        scene_file_time = write_time;
+                        // let the render thread finish every queued frame before the scene changes under it
+                        while (pipeline.acquire())
+                            pipeline.release();
+                        if (reload_scene(scene, bvh, cam, options, scene_file_objects, scene_file_hash, cache))
+                        {
+                            progressive.reset();
+                            temporal.reset();
+                        }
+                        pipeline.submit(cam);
+                    }
+                }
+
+                // start tracing the next frame with the current camera, then wait for the previous one
+                const Framebuffer *frame_buffer;
+                {
+                    PROFILE_STAGE("wait for frame");
+                    pipeline.submit(cam);
+                    frame_buffer = pipeline.acquire();
+                }
+
+                void *pixels;
+                int pitch;
+                {
+                    PROFILE_STAGE("texture update");
+                    if (frame_buffer && SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0)
+                    {
+#if defined(TEXTURE_TEST)
+                        for (int y = 0; y < cam.image_height; ++y)
+                        {
+                            for (int x = 0; x < cam.image_width; ++x)
+                            {
+                                Uint32 *pixel = reinterpret_cast<Uint32 *>(static_cast<Uint8 *>(pixels) + y * pitch) + x;
+                                *pixel = 255u << 24 | static_cast<Uint32>(((float)x) / cam.image_width * 255) << 16 | static_cast<Uint32>(((float)y) / cam.image_height * 255) << 8;
+                            }
+                        }
+#else
+                        frame_buffer->convert_rgba8(pixels, pitch, layout, options.display, 0, cam.image_height);
+#endif
+                        SDL_UnlockTexture(texture);
+                    }
+                    pipeline.release();
+                }
+
+                {
+                    PROFILE_STAGE("present");
+                    // Clear before update
+                    SDL_RenderClear(renderer);
+                    // Render the texture
+                    SDL_RenderCopy(renderer, texture, NULL, NULL);
+
+                    // Update the window surface
+                    SDL_RenderPresent(renderer);
+                }
+
+                // the title is the overlay: rolling frame time percentiles, the progressive sample count, the reprojected pixels
+                // and the render scale
+                if (std::chrono::steady_clock::now() - title_time > TITLE_INTERVAL ||
+                    (options.progressive && samples_per_pixel != shown_samples))
+                {
+                    title_time = std::chrono::steady_clock::now();
+                    shown_samples = samples_per_pixel;
+                    StageSummary frame = Profiler::get().summary(frame_stage);
+                    char title[128];
+                    std::snprintf(title, sizeof(title), "Raytracer - frame p50 %.1f p95 %.1f p99 %.1f ms", frame.p50_ms, frame.p95_ms, frame.p99_ms);
+                    std::string text = title;
+                    if (options.progressive)
+                        text += " - " + std::to_string(shown_samples) + " spp";
+                    else if (options.temporal && !options.adaptive)
+                        text += " - " + std::to_string(reused_percent) + "% reused";
+                    else if (options.dynamic_resolution && !options.adaptive)
+                        text += " - " + std::to_string(scale_percent) + "% scale";
+                    SDL_SetWindowTitle(window, text.c_str());
+                }
+                // nothing changes on screen until the camera moves, do not spin on the converged or cached image
+                if ((options.progressive && converged) || frame_reused)
+                    SDL_Delay(10);
+
+                frame_number++;
+            }
+            // properly dispose of the resources allocated by the SDL backend
+            SDL_DestroyTexture(texture);
+            SDL_DestroyRenderer(renderer);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+
+            // log the average time taken by every step
+            if (performance_logging)
+            {
+                std::cout << "Render threads: " << pool.size() << ", frame buffers: " << pipeline.buffer_count() << "\n";
+                std::cout << "Number of frames: " << frame_number << "\n";
+                Profiler::get().report(std::cout);
+                if (options.progressive)
+                    std::cout << "   progressive: " << progressive.stats().resets << " restarts, " << progressive.stats().samples_per_pixel
+                              << " spp in the last view, last change " << progressive.stats().change << "\n";
+                if (traced_paths > 0)
+                    std::cout << "   " << static_cast<double>(traced_segments) / traced_paths << " ray segments per path on average\n";
+                if (options.temporal && !options.progressive && !options.adaptive)
+                    std::cout << "   temporal reprojection: " << temporal.stats().reused_fraction() * 100 << "% of the last frame reused, "
+                              << temporal.stats().resets << " frames traced completely\n";
+                else if (options.dynamic_resolution && !options.progressive && !options.adaptive)
+                    std::cout << "   dynamic resolution: scale " << dynamic_resolution.stats().scale << " in the last frame, "
+                              << dynamic_resolution.stats().mean_scale() << " on average, changed " << dynamic_resolution.stats().changes
+                              << " times for a budget of " << options.resolution_settings.target_ms << " ms\n";
+                else if (options.cache && !options.progressive && !options.adaptive)
+                    std::cout << "   render cache: " << cache.stats().traced << " frames traced, " << cache.stats().reshaded
+                              << " reshaded from the G-buffer, " << cache.stats().reused << " reused\n";
+                if (options.adaptive && adaptive_frames > 0)
+                    std::cout << "   adaptive anti-aliasing: " << adaptive_edge_pixels / adaptive_frames << " edge pixels and "
+                              << adaptive_extra_rays / adaptive_frames << " extra rays per frame (budget "
+                              << static_cast<int64_t>(options.adaptive_settings.budget * cam.image_width * cam.image_height) << ")\n";
+            }
+
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,55 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "framebuffer.h"
+#include "adaptive.h"
+#include "gbuffer.h"
+#include "temporal.h"
+#include "resolution.h"
+
+struct ViewerOptions
+{
+    PixelPrecision precision = PixelPrecision::Float;
+    DisplaySettings display;
+    // number of frames in flight, 2 overlaps tracing with presentation, 3 also absorbs slow presents
+    int frame_buffers = 2;
+    // accumulate jittered samples while the camera stands still
+    bool progressive = false;
+    // supersample the edges of every frame, ignored in progressive mode
+    bool adaptive = false;
+    AdaptiveSettings adaptive_settings;
+    // reuse the last frame or its primary hits while the view and the geometry stay the same, see RenderCache.
+    // Ignored in progressive and adaptive mode
+    bool cache = true;
+    // reproject the last frame while the camera moves, see TemporalRenderer. Takes precedence over the cache,
+    // ignored in progressive and adaptive mode
+    bool temporal = false;
+    TemporalSettings temporal_settings;
+    // lower the internal resolution to keep the render time of a frame within the budget, see DynamicResolution.
+    // Takes precedence over the cache, ignored in progressive, adaptive and temporal mode
+    bool dynamic_resolution = false;
+    ResolutionSettings resolution_settings;
+    // scene file that is re-read when it changes, empty to keep the scene. Only the first scene_file_objects
+    // objects came from the file, the ones after them are kept on reload
+    std::string scene_file;
+    size_t scene_file_objects = 0;
+    // SceneLoadStats::geometry_hash of the scene file, a reload with the same hash keeps the primary hits
+    uint64_t scene_file_hash = 0;
+    // light set the render settings point to, replaced by the lights of the file on reload
+    LightSet *lights = nullptr;
+};
+
+/*
+* Interactive SDL front end. Opens a window of the camera's image size and renders frames until the
+* window is closed, the camera is moved with the keyboard. Frames are traced ahead on a render thread and
+* streamed into a single texture with the display settings. With a scene file in the options the scene and bvh
+* are replaced while no frame is in flight whenever the file changes. Returns the process exit code.
+*/
+int run_viewer(Scene &scene, BVH &bvh, Camera &cam, std::vector<vec3> u,
+               ThreadPool &pool, const RenderSettings &settings, const ViewerOptions &options);
+
+#endif
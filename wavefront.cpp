@@ -0,0 +1,229 @@
+#include "wavefront.h"
+#include <algorithm>
+#include <atomic>
+
+#include "profiler.h"
+
+namespace
+{
+// rays per task of the shade and intersect stages
+constexpr int QUEUE_CHUNK = 256;
+// origin cells per axis of the sort key, a power of two
+constexpr int SORT_CELL_BITS = 3;
+constexpr int SORT_CELLS = 1 << SORT_CELL_BITS;
+constexpr uint32_t SORT_KEYS = 8u << (3 * SORT_CELL_BITS);
+// key of a path that ended, sorted behind all others and dropped
+constexpr uint32_t ENDED = SORT_KEYS;
+// smallest number of rays per task of the sort
+constexpr size_t SORT_SLICE = 16384;
+
+// one path of the queue with the ray it continues with. Its hit is kept apart, it is only needed between the
+// intersect and the shade stage, so sorting does not move it
+struct QueuedRay
+{
+    ray r;
+    PathState path;
+    // pixel of the path in the rendered rows
+    int pixel;
+    uint32_t key;
+};
+
+// spreads the bits of a cell coordinate three apart for the Morton order
+uint32_t spread_bits(uint32_t v)
+{
+    uint32_t result = 0;
+    for (int bit = 0; bit < SORT_CELL_BITS; bit++)
+        result |= ((v >> bit) & 1u) << (3 * bit);
+    return result;
+}
+
+// cells of the sort key, a grid of SORT_CELLS^3 over the bounds of the scene
+struct SortGrid
+{
+    point3 min;
+    vec3 cells_per_unit;
+
+    explicit SortGrid(const AABB &bounds) : min{bounds.min}
+    {
+        vec3 extent = bounds.max - bounds.min;
+        cells_per_unit = vec3(extent.x > 0 ? SORT_CELLS / extent.x : 0, extent.y > 0 ? SORT_CELLS / extent.y : 0,
+                              extent.z > 0 ? SORT_CELLS / extent.z : 0);
+    }
+
+    // direction octant in the high bits, then the origin cell on a Morton curve
+    uint32_t key(const ray &r) const
+    {
+        vec3 direction = r.get_direction();
+        vec3 cell = (r.get_origin() - min) * cells_per_unit;
+        auto clamp_cell = [](double c) { return static_cast<uint32_t>(std::clamp(c, 0., SORT_CELLS - 1.)); };
+        uint32_t octant = (direction.x < 0) | (direction.y < 0) << 1 | (direction.z < 0) << 2;
+        return octant << (3 * SORT_CELL_BITS) | spread_bits(clamp_cell(cell.x)) | spread_bits(clamp_cell(cell.y)) << 1 |
+               spread_bits(clamp_cell(cell.z)) << 2;
+    }
+};
+
+/*
+* Counting sort of the first size rays of queue by key into sorted, ended paths are dropped. Returns the number
+* of rays left. The key range is small enough for one histogram per task. Every task counts and then scatters a
+* slice of the queue, the rays of a slice go behind those with the same key in the slices before it, so the order
+* is that of a serial counting sort for any number of tasks.
+*/
+size_t sort_queue(ThreadPool &pool, const std::vector<QueuedRay> &queue, size_t size, std::vector<QueuedRay> &sorted,
+                  std::vector<uint32_t> &offsets)
+{
+    PROFILE_STAGE("sort rays");
+    // ENDED is a key of its own
+    constexpr size_t KEYS = SORT_KEYS + 1;
+    int tasks = static_cast<int>(std::clamp<size_t>(size / SORT_SLICE, 1, pool.size()));
+    auto slice_begin = [&](int task) { return size * task / tasks; };
+    offsets.assign(tasks * KEYS, 0);
+    pool.parallel_for(tasks, [&](int task, int) {
+        uint32_t *histogram = &offsets[task * KEYS];
+        for (size_t i = slice_begin(task); i < slice_begin(task + 1); i++)
+            histogram[queue[i].key]++;
+    });
+    uint32_t total = 0;
+    for (size_t key = 0; key < KEYS; key++)
+    {
+        for (int task = 0; task < tasks; task++)
+        {
+            uint32_t count = offsets[task * KEYS + key];
+            offsets[task * KEYS + key] = total;
+            total += count;
+        }
+    }
+    pool.parallel_for(tasks, [&](int task, int) {
+        uint32_t *next = &offsets[task * KEYS];
+        for (size_t i = slice_begin(task); i < slice_begin(task + 1); i++)
+        {
+            if (queue[i].key != ENDED)
+                sorted[next[queue[i].key]++] = queue[i];
+        }
+    });
+    // the ended paths sort behind all others, the first of them marks the end of the live rays
+    return offsets[ENDED];
+}}
+
+RenderStats rt_wavefront(std::vector<vec3> u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                         Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings, int first_row, int row_count,
+                         int *hit_ids)
+{
+    int width = cam.image_width;
+    int row_end = std::min(first_row + row_count, static_cast<int>(cam.image_height));
+    int rows = row_end - first_row;
+    size_t pixels = static_cast<size_t>(rows) * width;
+    // the buffers are kept for the next frame of the calling thread, they have room for one ray per pixel and
+    // only the first queue_size rays are live. hits[i] is the hit of queue[i]
+    thread_local std::vector<QueuedRay> queue_storage, next_storage;
+    thread_local std::vector<Collision> hit_storage;
+    thread_local std::vector<uint32_t> offsets;
+    // the workers see their own thread_local instances, the tasks use these references
+    std::vector<QueuedRay> &queue = queue_storage, &next = next_storage;
+    std::vector<Collision> &hits = hit_storage;
+    if (queue.size() < pixels)
+    {
+        queue.resize(pixels);
+        next.resize(pixels);
+        hits.resize(pixels);
+    }
+    size_t queue_size = pixels;
+    SortGrid grid(bvh.bounds());
+    std::atomic<int64_t> segments{0};
+
+    // generate: the primary rays keep the tile order of rt_rows and are intersected as packets
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (rows + TILE_SIZE - 1) / TILE_SIZE;
+    pool.parallel_for(tiles_x * tiles_y, [&](int tile, int) {
+        PROFILE_SCOPE("generate");
+        int tile_x = (tile % tiles_x) * TILE_SIZE;
+        int tile_y = first_row + (tile / tiles_x) * TILE_SIZE;
+        int column_end = std::min(tile_x + TILE_SIZE, width), tile_row_end = std::min(tile_y + TILE_SIZE, row_end);
+        auto enqueue = [&](int i, int j, const ray &r, const Collision &col) {
+            size_t pixel = static_cast<size_t>(i - first_row) * width + j;
+            if (hit_ids)
+                hit_ids[(i - first_row) * frame_buffer.get_width() + j] = col.hit_object_index;
+            queue[pixel] = QueuedRay{r, start_path(r, settings), static_cast<int>(pixel), 0};
+            hits[pixel] = col;
+        };
+        for (int row = tile_y; row < tile_row_end; row += PACKET_WIDTH)
+        {
+            for (int column = tile_x; column < column_end; column += PACKET_WIDTH)
+            {
+                if (!settings.packets)
+                {
+                    for (int i = row; i < std::min(row + PACKET_WIDTH, tile_row_end); i++)
+                    {
+                        for (int j = column; j < std::min(column + PACKET_WIDTH, column_end); j++)
+                        {
+                            ray r = primary_ray(u, cam, j + settings.jitter_x, i + settings.jitter_y);
+                            enqueue(i, j, r, find_closest_hit(scene, bvh, r));
+                        }
+                    }
+                    continue;
+                }
+                RayPacket packet;
+                packet.origin = cam.position;
+                for (int lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    int i = row + lane / PACKET_WIDTH;
+                    int j = column + lane % PACKET_WIDTH;
+                    auto pixel_center = cam.image_top_left + u[0] * (j + settings.jitter_x) + u[1] * (i + settings.jitter_y);
+                    packet.set_direction(lane, cam.position - pixel_center);
+                    if (i < row_end && j < width)
+                        packet.active |= 1u << lane;
+                }
+                packet.finalize();
+                Collision collisions[PACKET_SIZE];
+                bvh.closest_hit(scene, packet, collisions);
+                for (int lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    if (packet.active & (1u << lane))
+                        enqueue(row + lane / PACKET_WIDTH, column + lane % PACKET_WIDTH, packet.lane_ray(lane), collisions[lane]);
+                }
+            }
+        }
+    });
+
+    for (;;)
+    {
+        // shade and spawn: every path collects the light of its hit in place and either ends, writing its pixel,
+        // or continues with its reflected ray and the sort key of that ray
+        int chunks = static_cast<int>((queue_size + QUEUE_CHUNK - 1) / QUEUE_CHUNK);
+        pool.parallel_for(chunks, [&](int chunk, int) {
+            PROFILE_SCOPE("shade");
+            size_t end = std::min(queue_size, static_cast<size_t>(chunk + 1) * QUEUE_CHUNK);
+            for (size_t i = static_cast<size_t>(chunk) * QUEUE_CHUNK; i < end; i++)
+            {
+                QueuedRay &queued = queue[i];
+                if (advance_path(scene, bvh, queued.r, hits[i], settings, queued.path))
+                {
+                    queued.key = grid.key(queued.r);
+                    continue;
+                }
+                queued.key = ENDED;
+                // a pixel has only one path in flight, so no other task writes it
+                frame_buffer.accumulate(queued.pixel / width, queued.pixel % width, queued.path.color, settings.sample_weight);
+            }
+            segments += end - static_cast<size_t>(chunk) * QUEUE_CHUNK;
+        });
+
+        queue_size = sort_queue(pool, queue, queue_size, next, offsets);
+        queue.swap(next);
+        if (queue_size == 0)
+            break;
+
+        // intersect: neighbouring rays of the sorted queue share most of their traversal
+        chunks = static_cast<int>((queue_size + QUEUE_CHUNK - 1) / QUEUE_CHUNK);
+        pool.parallel_for(chunks, [&](int chunk, int) {
+            PROFILE_SCOPE("intersect");
+            size_t end = std::min(queue_size, static_cast<size_t>(chunk + 1) * QUEUE_CHUNK);
+            for (size_t i = static_cast<size_t>(chunk) * QUEUE_CHUNK; i < end; i++)
+                hits[i] = find_closest_hit(scene, bvh, queue[i].r);
+        });
+    }
+
+    RenderStats stats;
+    stats.paths = static_cast<int64_t>(pixels);
+    stats.segments = segments;
+    return stats;
+}
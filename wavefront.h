@@ -0,0 +1,23 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+#include <vector>
+
+#include "renderer.h"
+
+/*
+* rt_rows traced breadth first. Instead of following every path to its end, all paths of the image advance one
+* bounce at a time through stages that each run over the whole ray queue across the pool:
+*   generate   primary rays of every pixel and their first hits, as packets per tile like rt_rows
+*   shade      local color of every hit and the termination test of trace_path, misses add the sky
+*   spawn      the reflected rays of the surviving paths form the next queue
+*   sort       the queue is ordered by direction octant, then by the cell of its origin on a Morton curve
+*   intersect  closest hits of the sorted queue
+* Sorting puts rays that traverse the same part of the hierarchy in the same direction next to each other, so
+* the nodes and primitives one task touches stay in cache. Every path runs the same arithmetic as in trace_path,
+* so the colors are the same as with settings.wavefront off. Selected by RenderSettings::wavefront.
+*/
+RenderStats rt_wavefront(std::vector<vec3> u, const Scene &scene, const BVH &bvh, const Camera &cam,
+                         Framebuffer &frame_buffer, ThreadPool &pool, const RenderSettings &settings, int first_row, int row_count,
+                         int *hit_ids = nullptr);
+
+#endif